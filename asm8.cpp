@@ -9,96 +9,253 @@ using namespace std;
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <algorithm>
 #include "asm8.h"
+#include "lex8.h"
+#include "trace8.h"
 
 asm8 *asm8::asm8_p;
 
-file_t::file_t(string _filename){
-    filename = _filename;
-    content = "";
-    current_line = 0;
-    total_lines = 0;
-    
-    filename_convert_slash();
-    
-    ifstream _file(filename);
-    if(!_file.is_open()) asm8::error(ERROR_OPEN_FILE, filename);
-    while(_file.peek() != EOF) content += tolower(_file.get());
-    _file.close();
-    content_convert_newline();
-    
-    for(uint32_t i = 0; i < content.length(); i++) if(content[i] == '\n') total_lines++;
+location_t::location_t(uint16_t _file_id, uint32_t _line){
+    file_id = _file_id;
+    line = _line;
 }
-void file_t::filename_convert_slash(){
-    uint32_t i;
-    while((i = filename.find("\\")) != string::npos) filename[i] = '/';
-}
-void file_t::content_convert_newline(){
-    uint32_t i;
-    while((i = content.find("\r\n")) != string::npos) content[i] = '\n';
-    while((i = content.find("\r")) != string::npos) content[i] = '\n';
+
+file_t::file_t(shared_ptr<const lexed_file_t> _source){
+    file_id = 0;
+    filename = _source->filename;
+    source = _source;
+    current_line = 0;
+    total_lines = _source->lines.size() - 1;
+    trace_start = 0;
 }
 
-define_t::define_t(string _name, int _value, string _details){
+define_t::define_t(string _name, int _value, location_t _first_defined){
     name = _name;
     value = _value;
-    details_first_defined = _details;
+    first_defined = _first_defined;
+    uses_labels = false;
+    evaluated = false;
+    evaluating = false;
+    generation = 0;
 }
 
-macro_t::macro_t(string _name, vector<string> _arg_list, vector<vector<string>> _code, string _details){
+macro_t::macro_t(string _name, vector<string> _arg_list, vector<line_t> _code, location_t _first_defined){
     name = _name;
-    arg_list = _arg_list;
-    code = _code;
+    arg_list = move(_arg_list);
+    code = move(_code);
     insert_count = 0;
-    details_first_defined = _details;
+    first_defined = _first_defined;
+}
+
+macro_rename_t::macro_rename_t(uint32_t _line, uint32_t _word, string _prefix, string _postfix){
+    line = _line;
+    word = _word;
+    prefix = _prefix;
+    postfix = _postfix;
+}
+
+label_t::label_t(string _name, location_t _first_defined){
+    name = _name;
+    address = 0;
+    first_defined = _first_defined;
+    relocatable = false;
+    is_global = false;
+    is_extern = false;
+    placed = false;
+}
+
+fixup_line_t::fixup_line_t(uint32_t _address, location_t _location, line_t _code){
+    address = _address;
+    location = _location;
+    code = move(_code);
 }
 
-label_t::label_t(string _name, string _details){
+diagnostic_t::diagnostic_t(int _code, string _message, location_t _location){
+    code = _code;
+    message = _message;
+    location = _location;
+}
+
+peephole_site_t::peephole_site_t(location_t _location, uint32_t _rule, uint32_t _bytes, uint32_t _cycles){
+    location = _location;
+    rule = _rule;
+    bytes = _bytes;
+    cycles = _cycles;
+}
+
+timing_t::timing_t(string _name, uint32_t _address){
+    name = _name;
+    address = _address;
+    cycles_min = 0;
+    cycles_max = 0;
+}
+
+code_section_t::code_section_t(string _name, location_t _first_defined){
     name = _name;
-    details_first_defined = _details;
+    fixed = false;
+    has_rule = false;
+    start = 0;
+    end = LINK8_MEMORY_SIZE - 1;
+    base = 0;
+    size = 0;
+    address = 0;
+    label_pc = 0;
+    first_defined = _first_defined;
+}
+
+code_chunk_t::code_chunk_t(int32_t _section, uint32_t _base){
+    section = _section;
+    base = _base;
+    size = 0;
 }
 
 asm8::asm8(){
     asm8_p = this;
     file_stack.clear();
     current_file = nullptr;
+    file_table.clear();
+    file_ids.clear();
     code.clear();
+    code_source.clear();
+    code_address.clear();
     code_line = 0;
     define_list.clear();
     macro_list.clear();
     label_list.clear();
+    label_generation = 0;
+    define_ids.clear();
+    macro_ids.clear();
+    label_ids.clear();
+    routine_timing_list.clear();
+    span_timing_list.clear();
     binary_out.clear();
+    segments.clear();
+    line_map.clear();
+    expansion_sites.clear();
+    expansion_site_lines.clear();
+    encode_source = location_t();
+    map_file = "";
+    map_binary_file = "";
+    size_report_file = "";
+    xref_file = "";
+    xref_uses.clear();
+    encode_macro = -1;
+    code_macro.clear();
+    file_bytes.clear();
+    label_bytes.clear();
+    macro_bytes.clear();
+    span_label = -1;
+    org_fill = 0xFF;
+    format = out8::format_bin;
     address = 0;
+    object_mode = false;
+    relocatable_pc = false;
+    global_list.clear();
+    streaming = false;
+    open_spans.clear();
+    fixups.clear();
+    fixup_lines.clear();
+    section_list.clear();
+    current_section = -1;
+    outside_address = 0;
+    outside_label_pc = 0;
+    diagnostics.clear();
+    max_errors = 20;
+    peephole = false;
+    peephole_bytes_saved = 0;
+    peephole_site_cycles = 0;
+    peephole_sites.clear();
+    peephole_hits.clear();
+    peephole_label_line.clear();
 }
 
+//Runs the passes; errors are collected on the way and reported at the end:
 int asm8::assemble(string _in, string _out){
+    int _result = -1;
+    trace_span_t _span("asm", "assemble", _in);
+    try{
+        _result = assemble_passes(_in, _out);
+    }
+    catch(const assembly_error_t &){}
+    catch(const error_limit_t &){}
+    reader.stop();
+    current_file = nullptr;
+    
+    if(diagnostics.size() > 0){
+        for(uint32_t i = 0; i < diagnostics.size(); i++){
+            string _location = format_location(diagnostics[i].location);
+            cerr << ((_location != "") ? _location + ":\n" : string("")) << "Error: " << diagnostics[i].message << endl;
+        }
+        cerr << diagnostics.size() << " error(s)";
+        if((max_errors > 0) && (diagnostics.size() >= max_errors)) cerr << ", stopped after " << max_errors;
+        cerr << endl;
+        return -1;
+    }
+    return _result;
+}
+
+int asm8::assemble_passes(string _in, string _out){
+    //Files are loaded and lexed on the reader thread while pass 1 runs:
+    reader.start();
+    trace_span_t _pass_1("asm", "pass 1");
     open_file(_in);
     
     //Pass 1: Search for defines, macros and labels:
     while(file_stack.size() > 0){
         while(current_file->current_line <= current_file->total_lines){
-            vector<string> _code_line = split_current_line_into_words();
-            current_file->current_line++;
-            if(_code_line.size() > 0){
-                if(is_directive(_code_line, include_d)){
-                    directive_include(_code_line);
-                }
-                else if(is_directive(_code_line, define_d)){
-                    directive_define(_code_line);
-                }
-                else if(is_directive(_code_line, macro_d)){
-                    directive_macro(_code_line);
-                }
-                else if(is_label(_code_line)){
-                    add_label(_code_line);
+            //A bad line is skipped, its error was recorded:
+            try{
+                line_t _code_line = split_current_line_into_words();
+                current_file->current_line++;
+                if(_code_line.size() > 0){
+                    if(is_directive(_code_line, include_d)){
+                        directive_include(_code_line);
+                    }
+                    else if(is_directive(_code_line, define_d)){
+                        directive_define(_code_line);
+                    }
+                    else if(is_directive(_code_line, macro_d)){
+                        directive_macro(_code_line);
+                    }
+                    else if(is_directive(_code_line, global_d)){
+                        directive_global(_code_line);
+                    }
+                    else if(is_directive(_code_line, extern_d)){
+                        directive_extern(_code_line);
+                    }
+                    else if(is_label(_code_line)){
+                        add_label(_code_line);
+                    }
                 }
             }
+            catch(const assembly_error_t &){}
         }
         close_current_file();
         if(file_stack.size() > 0){
             current_file = &file_stack.back();
         }
     }
+    current_file = nullptr;
+    //Pass 2 only reopens files that are cached by now:
+    reader.stop();
+    _pass_1.end();
+    
+    trace_span_t _defines("asm", "resolve defines");
+    resolve_defines();
+    _defines.end();
+    
+    for(uint32_t i = 0; i < global_list.size(); i++){
+        line_t _label;
+        _label.push_back(global_list[i]);
+        if(get_label_id(_label) < 0) error(ERROR_RELOCATION, "undefined global label " + global_list[i]);
+        label_list[get_label_id(_label)].is_global = true;
+    }
+    if(!object_mode){
+        for(uint32_t i = 0; i < label_list.size(); i++)
+            if(label_list[i].is_extern) error(ERROR_RELOCATION, "external label " + label_list[i].name + " needs object output (-c)");
+    }
     
     //DEBUG:
     cout << "--------------------------------" << endl;
@@ -108,112 +265,223 @@ int asm8::assemble(string _in, string _out){
             "\n\tMacros: \t" << macro_list.size() << endl;
     cout << "--------------------------------" << endl;
     
+    address = 0;
+    open_spans.clear();
+    fixups.clear();
+    fixup_lines.clear();
+    if(object_mode){
+        object = object_t();
+        object.sections.push_back(section_t("text", false, 0));
+    }
+    
     //Pass 2: insert defines and macros
+    trace_span_t _pass_2("asm", "pass 2");
     uint32_t _pass_2_address = 0;
     uint32_t _pass_2_label_pc = 0;
-    uint32_t _tries_pass_2 = 0;
+    relocatable_pc = object_mode;
+    section_list.clear();
+    current_section = -1;
     open_file(_in);
     while(file_stack.size() > 0){
-        vector<vector<string>> _code;
+        vector<line_t> _code;
         int32_t _cline = 0;
+        //Every expanded line remembers the macro call it came from, so a call
+        //that is already being expanded further up can be reported:
+        vector<int32_t> _line_expansion;
+        vector<uint32_t> _expansion_macro;
+        vector<int32_t> _expansion_parent;
+        //Lines of open .rept blocks are only sized when the outermost .endr is reached:
+        vector<uint32_t> _rept_start;
+        //Expansion sites waiting for the address of the line they start at:
+        vector<uint32_t> _site_line;
+        vector<uint32_t> _site_id;
+        //All macro calls a source line expands to are traced as one burst:
+        uint64_t _burst_start;
+        string _burst_macro;
         while(current_file->current_line <= current_file->total_lines){
-            _code.clear();
-            _cline = 0;
-            _code.push_back(split_current_line_into_words());
-            _tries_pass_2 = 0;
-            current_file->current_line++;
-            while(_cline < _code.size()){
-                if((_code[_cline].size() > 0)){
-                    if(is_directive(_code[_cline], include_d)){
-                        directive_include(_code[_cline]);
-                        _code[_cline].clear();
-                        _code[_cline].push_back("");
-                    }
-                    else if(is_directive(_code[_cline], define_d)){
-                        _code[_cline] = split_current_line_into_words();
-                    }
-                    else if(is_directive(_code[_cline], macro_d)){
-                        skip_directive_macro(_code[_cline]);
-                        _code[_cline] = split_current_line_into_words();
-                    }
-                    else if(is_directive(_code[_cline], base_d)){
-                        _pass_2_label_pc = string_to_num(_code[_cline][1]);
-                    }
-                    else if(is_directive(_code[_cline], org_d)){
-                        uint32_t _pass_2_org = string_to_num(_code[_cline][1]);
-                        if(_pass_2_org < _pass_2_address) error(ERROR_ORG_BACK);
-                        _pass_2_address = _pass_2_org;
-                        _pass_2_label_pc = _pass_2_org;
-                    }
-                    else if(is_directive(_code[_cline], db_d)){
-                        _pass_2_address += get_db_size(_code[_cline]);
-                        _pass_2_label_pc += get_db_size(_code[_cline]);
-                    }
-                    else if(is_directive(_code[_cline], dsb_d)){
-                        directive_dsb(_code[_cline], _pass_2_label_pc);
-//                        _pass_2_address += get_dsb_size(_code[_cline]);
-                        _pass_2_label_pc += get_dsb_size(_code[_cline]);
-                    }
-                    
-                    if(is_label(_code[_cline])){
-                        if(get_label_id(_code[_cline]) < 0) add_label(_code[_cline]);
-                        set_label_addr(get_label_id(_code[_cline]), _pass_2_label_pc);
-                    }
-                    
-                    if(contains_define(_code[_cline]) || contains_macro(_code[_cline]) || contains_label(_code[_cline])){
-                        if(contains_define(_code[_cline])){
-                            _code[_cline] = insert_define(_code[_cline]);
-                            continue;
+            try{
+                _burst_start = 0;
+                _code.clear();
+                _rept_start.clear();
+                _site_line.clear();
+                _site_id.clear();
+                _line_expansion.clear();
+                _expansion_macro.clear();
+                _expansion_parent.clear();
+                _cline = 0;
+                _code.push_back(split_current_line_into_words());
+                _line_expansion.push_back(-1);
+                current_file->current_line++;
+                while(_cline < _code.size()){
+                    if((_code[_cline].size() > 0)){
+                        if(is_directive(_code[_cline], include_d)){
+                            directive_include(_code[_cline]);
+                            _code[_cline].clear();
+                            _code[_cline].push_back("");
+                        }
+                        else if(is_directive(_code[_cline], define_d)){
+                            _code[_cline].clear();
                         }
-                        else if(contains_macro(_code[_cline])){
-                            vector<vector<string>> _macro_code = insert_macro(_code[_cline]);
-                            _code[_cline] = _macro_code[0];
-                            for(uint32_t i = 1; i < _macro_code.size(); i++)
-                                _code.insert(_code.begin() + _cline + i, _macro_code[i]);
-                            continue;
+                        else if(is_directive(_code[_cline], macro_d)){
+                            skip_directive_macro(_code[_cline]);
+                            _code[_cline].clear();
                         }
+                        else{
+                            //Defines over labels stay in the line until it is encoded, only
+                            //the directives that place code need their value right away:
+                            if(contains_define(_code[_cline]))
+                                _code[_cline] = insert_define(_code[_cline], is_directive(_code[_cline], org_d) || is_directive(_code[_cline], base_d) || is_directive(_code[_cline], dsb_d));
+                            
+                            if(contains_macro(_code[_cline])){
+                                int32_t _macro_id = get_macro_id(_code[_cline][0]);
+                                if(_macro_id < 0) error(ERROR_INVALID_EXPRESSION, "macro call must start the line");
+                                check_macro_recursion(_expansion_macro, _expansion_parent, _line_expansion[_cline], _macro_id);
+                                _expansion_macro.push_back(_macro_id);
+                                _expansion_parent.push_back(_line_expansion[_cline]);
+                                _site_line.push_back(_cline);
+                                _site_id.push_back(expansion_sites.size());
+                                expansion_sites.push_back(map_line_t(0, 0, macro_list[_macro_id].name, current_location().file_id, current_location().line));
+                                expansion_site_lines.push_back(0);
+                                
+                                if((_burst_start == 0) && trace8::enabled.load(memory_order_relaxed)){
+                                    _burst_start = trace8::now();
+                                    _burst_macro = macro_list[_macro_id].name;
+                                }
+                                vector<line_t> _macro_code = insert_macro(_code[_cline]);
+                                _code[_cline] = _macro_code[0];
+                                _line_expansion[_cline] = _expansion_macro.size() - 1;
+                                for(uint32_t i = 1; i < _macro_code.size(); i++){
+                                    _code.insert(_code.begin() + _cline + i, _macro_code[i]);
+                                    _line_expansion.insert(_line_expansion.begin() + _cline + i, _expansion_macro.size() - 1);
+                                }
+                                continue;
+                            }
+                            
+                            if(is_directive(_code[_cline], rept_d)){
+                                //The body is kept once; it is repeated when it is encoded:
+                                int32_t _open = 0;
+                                for(uint32_t i = _cline; i < _code.size(); i++){
+                                    if(is_directive(_code[i], rept_d))      _open++;
+                                    else if(is_directive(_code[i], endr_d)) _open--;
+                                }
+                                uint32_t _rept_line = current_file->current_line;
+                                while(_open > 0){
+                                    if(current_file->current_line > current_file->total_lines) error(ERROR_REPT, "missing .endr for .rept in line " + to_string(_rept_line));
+                                    _code.push_back(split_current_line_into_words());
+                                    _line_expansion.push_back(_line_expansion[_cline]);
+                                    current_file->current_line++;
+                                    if(is_directive(_code.back(), rept_d))      _open++;
+                                    else if(is_directive(_code.back(), endr_d)) _open--;
+                                }
+                                _rept_start.push_back(_cline);
+                            }
+                            else if(is_directive(_code[_cline], endr_d)){
+                                if(_rept_start.size() < 1) error(ERROR_REPT, ".endr without .rept");
+                                uint32_t _start = _rept_start.back();
+                                _rept_start.pop_back();
+                                if(_rept_start.size() < 1){
+                                    uint32_t _rept_size = get_rept_size(vector<line_t>(_code.begin() + _start, _code.begin() + _cline + 1));
+                                    _pass_2_address += _rept_size;
+                                    _pass_2_label_pc += _rept_size;
+                                }
+                            }
+                            else if(_rept_start.size() > 0){
+                                if(is_label(_code[_cline]) || is_directive(_code[_cline], org_d) || is_directive(_code[_cline], base_d) || is_directive(_code[_cline], dsb_d) ||
+                                   is_directive(_code[_cline], include_d) || is_directive(_code[_cline], macro_d) || is_directive(_code[_cline], section_d))
+                                    error(ERROR_REPT, "labels, .org, .base, .dsb, .include, .macro and .section can not be repeated");
+                            }
+                            else if(is_directive(_code[_cline], section_d)){
+                                directive_section(_code[_cline], _pass_2_address, _pass_2_label_pc);
+                            }
+                            else if((current_section >= 0) && (is_directive(_code[_cline], base_d) || is_directive(_code[_cline], org_d))){
+                                error(ERROR_SECTION, ".org and .base can not be used inside a section");
+                            }
+                            else if(is_directive(_code[_cline], base_d)){
+                                _pass_2_label_pc = string_to_num(_code[_cline][1]);
+                                relocatable_pc = false;
+                            }
+                            else if(is_directive(_code[_cline], org_d)){
+                                uint32_t _pass_2_org = string_to_num(_code[_cline][1]);
+                                if(_pass_2_org < _pass_2_address) error(ERROR_ORG_BACK);
+                                _pass_2_address = _pass_2_org;
+                                _pass_2_label_pc = _pass_2_org;
+                                relocatable_pc = false;
+                            }
+                            else if(is_directive(_code[_cline], db_d) || is_directive(_code[_cline], dw_d) || is_directive(_code[_cline], fill_d)){
+                                uint32_t _data_size = get_data_size(_code[_cline]);
+                                _pass_2_address += _data_size;
+                                _pass_2_label_pc += _data_size;
+                            }
+                            else if(is_directive(_code[_cline], dsb_d)){
+                                directive_dsb(_code[_cline], _pass_2_label_pc);
+    //                            _pass_2_address += get_dsb_size(_code[_cline]);
+                                _pass_2_label_pc += get_dsb_size(_code[_cline]);
+                            }
+                            
+                            if(is_label(_code[_cline]) && (_rept_start.size() < 1)){
+                                if(get_label_id(_code[_cline]) < 0) add_label(_code[_cline]);
+                                set_label_addr(get_label_id(_code[_cline]), _pass_2_label_pc);
+                            }
+                        }
+                    }
+                    if((_rept_start.size() < 1) && check_instr_valid(_code[_cline])){
+                        uint8_t _instr_size = get_instr_size(_code[_cline]);
+                        _pass_2_address += _instr_size;
+                        _pass_2_label_pc += _instr_size;
                     }
+                    
+                    _cline++;
                 }
-                if(check_instr_valid(_code[_cline])){
-                    _pass_2_address += get_instr_size(_code[_cline]);
-                    _pass_2_label_pc += get_instr_size(_code[_cline]);
+                if(_burst_start != 0) trace8::record("asm", "macro expansion", _burst_macro, _burst_start, trace8::now());
+                
+                for(uint32_t i = 0; i < _code.size(); i++){
+                    if(!(is_directive(_code[i], any_d)) && (_code[i].size() > 0)){
+    //                    //DEBUG
+    //                    for(uint32_t j = 0; j < _code[i].size(); j++) cout << _code[i][j] << " ";
+    //                    cout << endl;
+                        
+                        if(!check_instr_valid(_code[i])) error(ERROR_INVALID_INSTR);
+                    }
+    //                //DEBUG
+    //                else{
+    //                    cout << endl;
+    //                }
                 }
                 
-                if(_cline < _code.size()) _cline++;
+    //            //DEBUG
+    //            for(uint32_t i = 0; i < _code.size(); i++){
+    //                for(uint32_t j = 0; j < _code[i].size(); j++) cout << _code[i][j] << " ";
+    //                cout << endl;
+    //            }
                 
-                if(_tries_pass_2 >= MAX_TRIES_PASS_2)   error(ERROR_MAX_TRIES_PASS_2);
-                else                                    _tries_pass_2++;
-            }
-            
-            for(uint32_t i = 0; i < _code.size(); i++){
-                if(!(is_directive(_code[i], any_d)) && (_code[i].size() > 0)){
-//                    //DEBUG
-//                    for(uint32_t j = 0; j < _code[i].size(); j++) cout << _code[i][j] << " ";
-//                    cout << endl;
-                    
-                    if(!check_instr_valid(_code[i])) error(ERROR_INVALID_INSTR);
+                //Streaming mode encodes every source line as soon as it is expanded:
+                for(uint32_t i = 0; i < _code.size(); i++){
+                    for(uint32_t j = 0; j < _site_line.size(); j++){
+                        if(_site_line[j] != i) continue;
+                        if(streaming) expansion_sites[_site_id[j]].address = address;
+                        else          expansion_site_lines[_site_id[j]] = code.size();
+                    }
+                    int32_t _macro_id = (_line_expansion[i] >= 0) ? _expansion_macro[_line_expansion[i]] : -1;
+                    if(streaming){
+                        encode_source = current_location();
+                        encode_macro = _macro_id;
+                        i = encode_at(_code, i);
+                        continue;
+                    }
+                    code.push_back(_code[i]);
+                    code_source.push_back(current_location());
+                    code_macro.push_back(_macro_id);
                 }
-//                //DEBUG
-//                else{
-//                    cout << endl;
-//                }
-            }
-            
-//            //DEBUG
-//            for(uint32_t i = 0; i < _code.size(); i++){
-//                for(uint32_t j = 0; j < _code[i].size(); j++) cout << _code[i][j] << " ";
-//                cout << endl;
-//            }
-            
-            for(uint32_t i = 0; i < _code.size(); i++){
-                code.push_back(_code[i]);
             }
+            catch(const assembly_error_t &){}
         }
         close_current_file();
         if(file_stack.size() > 0){
             current_file = &file_stack.back();
         }
     }
+    current_file = nullptr;
+    _pass_2.end();
     
 //    //DEBUG
 //    for(uint32_t i = 0; i < code.size(); i++){
@@ -222,193 +490,187 @@ int asm8::assemble(string _in, string _out){
 //        cout << endl;
 //    }
     
-    //Pass 3: Assemble code
-    uint32_t _pass_3_label_pc = 0;
-    uint32_t _last_pass_3_label_pc = -1;
-    vector<uint8_t> _translated_code;
-    address = 0;
-    for(uint32_t i = 0; i < code.size(); i++){
-        //DEBUG
-        if(code[i].size() > 0){
-            char _buf[32];
-            sprintf(_buf, "0x%04X:\t", address);
-            cout << _buf;
-            
-            for(uint32_t j = 0; j < code[i].size(); j++) cout << code[i][j] << " ";
-            
-            cout << endl;
+    if(streaming){
+        trace_span_t _fixups("asm", "resolve fixups");
+        resolve_fixups();
+        encode_source = location_t();
+    }
+    else{
+        //Optional peephole pass on the expanded code, before it is encoded:
+        if(peephole){
+            trace_span_t _optimize("asm", "optimize");
+            optimize();
+        }
         
-            _last_pass_3_label_pc = _pass_3_label_pc;
-            if(check_instr_valid(code[i])) _pass_3_label_pc += get_instr_size(code[i]);
-            
-            if(contains_label(code[i])){
-                code[i] = insert_label(code[i]);
-            }
-            if(contains_expression(code[i])){
-                code[i] = evaluate_expression(code[i]);
+        //Sections are placed once their size is final:
+        if(section_list.size() > 0){
+            trace_span_t _place("asm", "place sections");
+            place_sections();
+        }
+        
+        //Pass 3: Assemble code
+        trace_span_t _pass_3("asm", "pass 3");
+        code_address.resize(code.size());
+        for(uint32_t i = 0; i < code.size(); i++){
+            uint32_t _first = i;
+            code_address[i] = address;
+            encode_source = code_source[i];
+            encode_macro = code_macro[i];
+            try{
+                i = encode_at(code, i);
             }
-            _translated_code = translate_instr(code[i]);
-            for(uint32_t j = 0; j < _translated_code.size(); j++){
-                binary_out.push_back(_translated_code[j]);
-                address++;
+            catch(const assembly_error_t &){
+                //The rest of a failed .rept block is skipped with it:
+                if(is_directive(code[i], rept_d) && (find_endr(code, i) >= 0)) i = find_endr(code, i);
             }
+            for(uint32_t j = _first + 1; j <= i; j++) code_address[j] = code_address[_first];
         }
+        encode_source = location_t();
+        for(uint32_t i = 0; i < expansion_sites.size(); i++)
+            expansion_sites[i].address = (expansion_site_lines[i] < code_address.size()) ? code_address[expansion_site_lines[i]] : address;
     }
     
-    ofstream ofile;
-    ofile.open(_out.c_str(), ios::out | ios::binary | ios::trunc);
-    if(!ofile.is_open()) return error(ERROR_CREATE_FILE, _out);
-    for(uint32_t i = 0; i < binary_out.size(); i++) ofile.put(binary_out[i]);
-    ofile.close();
+    if(open_spans.size() > 0) error(ERROR_TIMING_SPAN, "missing .endtiming for " + span_timing_list[open_spans.back()].name);
+    
+    //Nothing is written when a line failed:
+    if(diagnostics.size() > 0) return -1;
     
-    cout << "\nFile successfully assembled\n" << "File saved to: " << _out << endl;
+    print_timing_report();
+    
+    trace_span_t _write("write", "write output", _out);
+    if(((map_file != "") || (map_binary_file != "")) && (write_map() != 0)) return -1;
+    if((size_report_file != "") && (write_size_report(size_report_file) != 0)) return -1;
+    if((xref_file != "") && (write_xref() != 0)) return -1;
+    
+    //Without an output name the image only stays in binary_out:
+    if(_out == "") return 0;
+    if(object_mode) return write_object(_out);
+    
+    int _written = out8::write(_out, format, binary_out, segments);
+    if(_written < 0) return error(ERROR_CREATE_FILE, _out);
+    
+    cout << "\nFile successfully assembled\n" << ((_written == 0) ? "File saved to: " : "File unchanged: ") << _out << endl;
     
     return 0;
 }
 
 void asm8::open_file(string _filename){
     if(file_stack.size() > MAX_FILE_STACK_SIZE) error(ERROR_FILE_STACK_OVERFLOW);
-    file_t _file(_filename);
-    file_stack.push_back(_file);
+    shared_ptr<const lexed_file_t> _source = reader.get(_filename);
+    if(!_source->opened) error(ERROR_OPEN_FILE, _source->filename);
+    file_t _file(_source);
+    _file.file_id = get_file_id(_file.filename);
+    if(trace8::enabled.load(memory_order_relaxed)) _file.trace_start = trace8::now();
+    file_stack.push_back(move(_file));
     current_file = &file_stack.back();
 }
 
+uint16_t asm8::get_file_id(string _filename){
+    map<string, uint16_t>::iterator _it = file_ids.find(_filename);
+    if(_it != file_ids.end()) return _it->second;
+    file_table.push_back(_filename);
+    file_ids[_filename] = file_table.size() - 1;
+    return file_table.size() - 1;
+}
+
+location_t asm8::current_location(){
+    if(current_file == nullptr) return location_t();
+    return location_t(current_file->file_id, current_file->current_line);
+}
+
+//The line being read, or the one being encoded once the files are closed;
+//the file id is out of range when there is neither:
+location_t asm8::source_location(){
+    if(current_file != nullptr) return current_location();
+    if(encode_source.line > 0) return encode_source;
+    return location_t(file_table.size(), 0);
+}
+
+//Records a use for the cross-reference index:
+void asm8::add_xref(uint8_t _kind, uint32_t _id, location_t _location){
+    if((xref_file == "") || (_location.file_id >= file_table.size())) return;
+    xref_uses.push_back(xref_use_t((_kind << 24) | _id, _location.file_id, _location.line));
+}
+
+//Locations are only turned into text when a message is actually printed:
+string asm8::format_location(location_t _location){
+    if(_location.file_id >= file_table.size()) return "";
+    return file_table[_location.file_id] + ", Line " + to_string(_location.line);
+}
+
 void asm8::close_current_file(){
-    if(file_stack.size() > 0) file_stack.pop_back();
-}
-
-vector<string> asm8::split_current_line_into_words(){
-    vector<string> _code;
-    if(current_file->current_line > current_file->total_lines) return _code;
-    uint32_t _cursor = 0;
-    for(uint32_t i = 0; i < current_file->current_line; i++){
-        if(current_file->content.find('\n', _cursor) == string::npos) break;
-        else _cursor = current_file->content.find('\n', _cursor) + 1;
-    }
-    uint32_t _len = (current_file->content.find('\n', _cursor) == string::npos) ? string::npos : current_file->content.find('\n', _cursor) - _cursor;
-    string _line = current_file->content.substr(_cursor, _len);
-    uint32_t _comment_begin = (_line.find(';') == string::npos) ? string::npos : _line.find(';');
-    _line = _line.substr(0, _comment_begin);
-    
-    string _word = "";
-    bool _was_special_char = false;
-    for(uint32_t i = 0; i <= _line.length(); i++){
-        _was_special_char = false;
-        for(uint32_t j = 0; j < special_char.length(); j++){
-            if(_line[i] == special_char[j]){
-                if(_word.length() > 0) _code.push_back(_word);
-                _code.push_back(special_char.substr(j, 1));
-                _word = "";
-                _was_special_char = true;
-            }
-        }
-        if(_was_special_char) continue;
-        if(!isspace(_line[i]) && !(_line[i] == '\0')){
-            _word += _line[i];
-        }
-        else if(_word.length() > 0){
-            _code.push_back(_word);
-            _word = "";
-        }
-    }
-    return _code;
+    if(file_stack.size() < 1) return;
+    if(file_stack.back().trace_start != 0) trace8::record("asm", "file", file_stack.back().filename, file_stack.back().trace_start, trace8::now());
+    file_stack.pop_back();
 }
 
-string asm8::add_label(vector<string> _code){
+//Lines are lexed by the reader when the file is loaded:
+line_t asm8::split_current_line_into_words(){
+    if(current_file->current_line > current_file->total_lines) return line_t();
+    return current_file->source->lines[current_file->current_line];
+}
+
+string asm8::add_label(line_t _code){
     if((_code.size() > 0)){
         if(_code[0].length() < 2) error(ERROR_INVALID_LABEL);
         if(!(isalpha(_code[0][0]) || (_code[0][0] == '_'))) error(ERROR_INVALID_LABEL);
         string _label_name = _code[0].substr(0, _code[0].find(":"));
-        for(uint32_t i = 0; i < label_list.size(); i++)
-            if(_label_name == label_list[i].name) error(ERROR_LABEL_ALREADY_EXISTS, _label_name + "\nfirst defined here: " + label_list[i].details_first_defined);
-        label_t _label(_label_name, current_file->filename + ", Line " + to_string(current_file->current_line));
-        label_list.push_back(_label);
+        int32_t _label_id = get_label_id(_label_name);
+        if(_label_id >= 0) error(ERROR_LABEL_ALREADY_EXISTS, _label_name + "\nfirst defined here: " + format_location(label_list[_label_id].first_defined));
+        label_ids[_label_name] = label_list.size();
+        label_list.push_back(label_t(_label_name, current_location()));
     }
     return "";
 }
 
-bool asm8::is_directive(vector<string> _code, uint32_t _directive){
+bool asm8::is_directive(line_t _code, uint32_t _directive){
     if(_code.size() < 1) return false;
     if(_directive == any_d) return (_code[0][0] == '.');
     else                    return (_code[0] == directives[_directive]);
 }
 
-bool asm8::is_label(vector<string> _code){
+bool asm8::is_label(line_t _code){
     if(_code.size() < 1) return false;
     return (_code[0].find(":") != string::npos);
 }
 
-bool asm8::is_define(vector<string> _code){
-    if(_code.size() < 1) return false;
-    bool _is_define = false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < define_list.size(); j++){
-            _is_define |= (_code[i] == define_list[j].name);
-        }
-    }
-    return _is_define;
+bool asm8::is_define(line_t _code){
+    return contains_define(_code);
 }
 
-bool asm8::is_macro(vector<string> _code){
-    if(_code.size() < 1) return false;
-    bool _is_macro = false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < macro_list.size(); j++){
-            _is_macro |= (_code[i] == macro_list[j].name);
-        }
-    }
-    return _is_macro;
+bool asm8::is_macro(line_t _code){
+    return contains_macro(_code);
 }
 
-bool asm8::contains_define(vector<string> _code){
-    if(_code.size() < 1) return false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < define_list.size(); j++){
-            if(_code[i] == define_list[j].name){
-                return true;
-            }
-        }
-    }
+bool asm8::contains_define(line_t _code){
+    for(uint32_t i = 0; i < _code.size(); i++) if(get_define_id(_code[i]) >= 0) return true;
     return false;
 }
 
-bool asm8::contains_macro(vector<string> _code){
-    if(_code.size() < 1) return false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < macro_list.size(); j++){
-            if(_code[i] == macro_list[j].name){
-                return true;
-            }
-        }
-    }
+bool asm8::contains_macro(line_t _code){
+    for(uint32_t i = 0; i < _code.size(); i++) if(get_macro_id(_code[i]) >= 0) return true;
     return false;
 }
 
-bool asm8::contains_label(vector<string> _code){
-    if(_code.size() < 1) return false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < label_list.size(); j++){
-            if(_code[i] == label_list[j].name){
-                return true;
-            }
-        }
-    }
+bool asm8::contains_label(line_t _code){
+    for(uint32_t i = 0; i < _code.size(); i++) if(get_label_id(_code[i]) >= 0) return true;
     return false;
 }
 
-bool asm8::contains_expression(vector<string> _code){
+bool asm8::contains_expression(line_t _code){
     if(_code.size() < 2) return false;
     for(uint32_t i = 0; i < _code.size(); i++) if(_code[i] == "(") return true;
     return false;
 }
 
-vector<string> asm8::insert_define(vector<string> _code){
-    if(_code.size() < 1) return _code;
+//With _labels false, defines that depend on labels are left in the line:
+line_t asm8::insert_define(line_t _code, bool _labels){
+    int32_t _define_id;
     for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < define_list.size(); j++){
-            if(_code[i] == define_list[j].name){
-                _code[i] = to_string(define_list[j].value);
-            }
+        if((_define_id = get_define_id(_code[i])) >= 0){
+            if(!_labels && define_list[_define_id].uses_labels) continue;
+            add_xref(xref_symbol_t::symbol_define, _define_id, source_location());
+            _code[i] = to_string(define_value(_define_id));
         }
     }
     
@@ -419,19 +681,21 @@ vector<string> asm8::insert_define(vector<string> _code){
     return _code;
 }
 
-vector<vector<string>> asm8::insert_macro(vector<string> _code){
-    vector<vector<string>> _macro_code;
-    vector<string> _macro_code_line;
-    vector<string> _arg_list;
+//Calls with the same arguments share one expansion; only the local labels
+//are renamed per call. Up to MAX_MACRO_CACHE_SIZE argument lists are kept
+//per macro, calls with other arguments expand without being cached:
+vector<line_t> asm8::insert_macro(line_t _code){
+    vector<line_t> _macro_code;
+    line_t _arg_list;
     string _arg;
-    uint32_t _macro_id;
+    string _key;
+    macro_expansion_t _expansion;
+    const macro_expansion_t *_cached;
     
     if(_code.size() < 1) return _macro_code;
-    for(uint32_t i = 0; i < macro_list.size(); i++){
-        if(_code[0] == macro_list[i].name){
-            _macro_id = i; break;
-        }
-    }
+    int32_t _macro_id = get_macro_id(_code[0]);
+    if(_macro_id < 0) return _macro_code;
+    add_xref(xref_symbol_t::symbol_macro, _macro_id, source_location());
     
     _arg = "";
     for(uint32_t i = 1; i < _code.size(); i++){
@@ -446,34 +710,25 @@ vector<vector<string>> asm8::insert_macro(vector<string> _code){
     }
     if(_arg_list.size() != macro_list[_macro_id].arg_list.size()) error(ERROR_MISSING_MACRO_ARGS);
     
-    for(uint32_t _mline = 0; _mline < macro_list[_macro_id].code.size(); _mline++){
-        _macro_code_line.clear();
-        for(uint32_t _mword = 0; _mword < macro_list[_macro_id].code[_mline].size(); _mword++){
-            _macro_code_line.push_back(macro_list[_macro_id].code[_mline][_mword]);
-            for(uint32_t i = 0; i < macro_list[_macro_id].arg_list.size(); i++){
-                if(_macro_code_line[_mword] == macro_list[_macro_id].arg_list[i]){
-                    _macro_code_line[_mword] = _arg_list[i];
-                }
-            }
-        }
-        _macro_code.push_back(_macro_code_line);
+    for(uint32_t i = 0; i < _arg_list.size(); i++) _key += _arg_list[i] + '\n';
+    unordered_map<string, macro_expansion_t> &_cache = macro_list[_macro_id].expansion_cache;
+    unordered_map<string, macro_expansion_t>::iterator _found = _cache.find(_key);
+    if(_found != _cache.end()){
+        _cached = &_found->second;
     }
-    
-    vector<string> _macro_label;
-    for(uint32_t i = 0; i < macro_list[_macro_id].code.size(); i++){
-        if(is_label(_macro_code[i])){
-            _macro_label.push_back(_macro_code[i][0].substr(0, _macro_code[i][0].find(":")));
-            _macro_code[i][0].insert(_macro_code[i][0].find(":"), string("_") + to_string(macro_list[_macro_id].insert_count));
-        }
+    else if(_cache.size() < MAX_MACRO_CACHE_SIZE){
+        _cached = &_cache.insert(make_pair(_key, expand_macro(_macro_id, _arg_list))).first->second;
     }
-    for(uint32_t _mline = 0; _mline < macro_list[_macro_id].code.size(); _mline++){
-        for(uint32_t _mword = 0; _mword < macro_list[_macro_id].code[_mline].size(); _mword++){
-            for(uint32_t i = 0; i < _macro_label.size(); i++){
-                if(_macro_code[_mline][_mword] == _macro_label[i]){
-                    _macro_code[_mline][_mword] = _macro_label[i] + (string("_") + to_string(macro_list[_macro_id].insert_count));
-                }
-            }
-        }
+    else{
+        _expansion = expand_macro(_macro_id, _arg_list);
+        _cached = &_expansion;
+    }
+    
+    _macro_code = _cached->code;
+    string _suffix = string("_") + to_string(macro_list[_macro_id].insert_count);
+    for(uint32_t i = 0; i < _cached->renames.size(); i++){
+        const macro_rename_t &_rename = _cached->renames[i];
+        _macro_code[_rename.line][_rename.word] = _rename.prefix + _suffix + _rename.postfix;
     }
     
     macro_list[_macro_id].insert_count++;
@@ -490,19 +745,58 @@ vector<vector<string>> asm8::insert_macro(vector<string> _code){
     return _macro_code;
 }
 
-vector<string> asm8::insert_label(vector<string> _code){
-    if(_code.size() < 1) return _code;
-    for(uint32_t i = 0; i < label_list.size(); i++){
-        for(uint32_t j = 0; j < _code.size(); j++){
-            if(_code[j].substr(0, _code[j].find(":")) == label_list[i].name){
-                _code[j] = to_string(label_list[i].address);
-                return _code;
+macro_expansion_t asm8::expand_macro(uint32_t _macro_id, const line_t &_arg_list){
+    macro_expansion_t _expansion;
+    line_t _macro_code_line;
+    const macro_t &_macro = macro_list[_macro_id];
+    
+    for(uint32_t _mline = 0; _mline < _macro.code.size(); _mline++){
+        _macro_code_line.clear();
+        for(uint32_t _mword = 0; _mword < _macro.code[_mline].size(); _mword++){
+            _macro_code_line.push_back(_macro.code[_mline][_mword]);
+            for(uint32_t i = 0; i < _macro.arg_list.size(); i++){
+                if(_macro_code_line[_mword] == _macro.arg_list[i]){
+                    _macro_code_line[_mword] = _arg_list[i];
+                }
+            }
+        }
+        _expansion.code.push_back(_macro_code_line);
+    }
+    
+    line_t _macro_label;
+    for(uint32_t i = 0; i < _expansion.code.size(); i++){
+        if(is_label(_expansion.code[i])){
+            string &_label = _expansion.code[i][0];
+            _macro_label.push_back(_label.substr(0, _label.find(":")));
+            _expansion.renames.push_back(macro_rename_t(i, 0, _macro_label.back(), _label.substr(_label.find(":"))));
+        }
+    }
+    for(uint32_t _mline = 0; _mline < _expansion.code.size(); _mline++){
+        for(uint32_t _mword = 0; _mword < _expansion.code[_mline].size(); _mword++){
+            for(uint32_t i = 0; i < _macro_label.size(); i++){
+                if(_expansion.code[_mline][_mword] == _macro_label[i]){
+                    _expansion.renames.push_back(macro_rename_t(_mline, _mword, _macro_label[i], ""));
+                    break;
+                }
             }
         }
     }
+    
+    return _expansion;
+}
+
+line_t asm8::insert_label(line_t _code){
+    int32_t _label_id;
+    for(uint32_t i = 0; i < _code.size(); i++){
+        if((_label_id = get_label_id(_code[i])) >= 0){
+            add_xref(xref_symbol_t::symbol_label, _label_id, source_location());
+            _code[i] = to_string(label_list[_label_id].address);
+        }
+    }
+    return _code;
 }
 
-vector<string> asm8::evaluate_expression(vector<string> _code){
+line_t asm8::evaluate_expression(line_t _code){
     if(_code.size() < 2) return _code;
     
     int32_t _result = 0;
@@ -510,58 +804,29 @@ vector<string> asm8::evaluate_expression(vector<string> _code){
     string _operation;
     
     uint32_t _exp_start = 0;
-    vector<string> _exp;
-    string _word = "";
-    bool _was_special_char = false;
-    for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j <= _code[i].size(); j++){
-            _was_special_char = false;
-            for(uint32_t k = 0; k < special_char.length(); k++){
-                if(_code[i][j] == special_char[k]){
-                    if(_word.length() > 0) _exp.push_back(_word);
-                    _exp.push_back(special_char.substr(k, 1));
-                    _word = "";
-                    _was_special_char = true;
-                }
-            }
-            if(_was_special_char) continue;
-            if(!isspace(_code[i][j]) && !(_code[i][j] == '\0')){
-                _word += _code[i][j];
-            }
-            else if(_word.length() > 0){
-                _exp.push_back(_word);
-                _word = "";
-            }
-        }
-    }
-    _code = _exp;
+    line_t _exp;
+    for(uint32_t i = 0; i < _code.size(); i++) lex8::split(_code[i], _exp);
+    _code = move(_exp);
     
-    uint32_t _tries = 0;
-    while(contains_define(_code) || contains_label(_code)){
-        if(contains_define(_code)){
-            _code = insert_define(_code);
-        }
-        else if(contains_label(_code)){
-            _code = insert_label(_code);
-        }
-        _tries++;
-        if(_tries > MAX_TRIES_PASS_2) error(ERROR_MAX_TRIES_PASS_2);
-    }
+    //Define values are already resolved and labels are plain addresses, so a
+    //single substitution leaves only numbers:
+    _code = insert_label(insert_define(_code));
     
     _result = 0;
     for(uint32_t i = 0; i < _code.size(); i++) if(_code[i] == "("){_exp_start = i + 1; break;}
+    int32_t _num;
     for(uint32_t i = _exp_start; i < _code.size(); i++){
-        if(isdigit(_code[i][0])){
-            if(_operation == "+")       _result += string_to_num(_code[i]);
-            else if(_operation == "-")  _result -= string_to_num(_code[i]);
-            else if(_operation == "<")  _result += (string_to_num(_code[i]) & 0xFF);
-            else if(_operation == ">")  _result += ((string_to_num(_code[i]) >> 8) & 0xFF);
-            else                        _result += string_to_num(_code[i]);
+        if(parse_num(_code[i], _num)){
+            if(_operation == "+")       _result += _num;
+            else if(_operation == "-")  _result -= _num;
+            else if(_operation == "<")  _result += (_num & 0xFF);
+            else if(_operation == ">")  _result += ((_num >> 8) & 0xFF);
+            else                        _result += _num;
         }
         else if(_code[i] == "("){
-            vector<string> _new_exp;
+            line_t _new_exp;
             bool _bracket_found = false;
-            for(uint32_t x = 0; x < _code.size(); x++){
+            for(uint32_t x = 0; i < _code.size(); x++){
                 _new_exp.push_back(_code[i]);
                 _code.erase(_code.begin() + i);
                 if(_new_exp[x] == ")"){
@@ -600,18 +865,207 @@ vector<string> asm8::evaluate_expression(vector<string> _code){
     return _code;
 }
 
-int32_t asm8::string_to_num(string _str){
-    if(_str.find("\'") != string::npos) return _str.substr(_str.find("\'") + 1, 1)[0];
-    else{
+//Defines may refer to other defines and labels in any order; the walk
+//reports circular defines and marks the ones that depend on labels. The
+//values themselves are evaluated by define_value() when first needed:
+void asm8::resolve_defines(){
+    vector<uint8_t> _state(define_list.size(), 0);
+    vector<uint32_t> _chain;
+    for(uint32_t i = 0; i < define_list.size(); i++){
         try{
-            if(_str.find("0x") != string::npos) return stoi(_str.substr(_str.find("0x")), nullptr, 16);
-            else                                return stoi(_str, nullptr, 10);
-        } catch(invalid_argument){error(ERROR_INVALID_EXPRESSION);}
+            resolve_define(i, _state, _chain);
+        }
+        catch(const assembly_error_t &){
+            for(uint32_t j = 0; j < _chain.size(); j++) _state[_chain[j]] = 2;
+            _chain.clear();
+        }
+    }
+}
+
+//_state: 0 = not visited, 1 = on the current chain, 2 = resolved:
+void asm8::resolve_define(uint32_t _define_id, vector<uint8_t> &_state, vector<uint32_t> &_chain){
+    if(_state[_define_id] == 2) return;
+    if(_state[_define_id] == 1){
+        string _cycle;
+        uint32_t i = find(_chain.begin(), _chain.end(), _define_id) - _chain.begin();
+        for(; i < _chain.size(); i++)
+            _cycle += define_list[_chain[i]].name + " (" + format_location(define_list[_chain[i]].first_defined) + ") -> ";
+        error(ERROR_CIRCULAR_REFERENCE, _cycle + define_list[_define_id].name);
+    }
+    
+    _state[_define_id] = 1;
+    _chain.push_back(_define_id);
+    
+    define_t &_define = define_list[_define_id];
+    for(uint32_t i = 0; i < _define.expression.size(); i++){
+        int32_t _dependency = get_define_id(_define.expression[i]);
+        if(_dependency >= 0){
+            add_xref(xref_symbol_t::symbol_define, _dependency, _define.first_defined);
+            resolve_define(_dependency, _state, _chain);
+            if(define_list[_dependency].uses_labels) _define.uses_labels = true;
+        }
+        else if(get_label_id(_define.expression[i]) >= 0) _define.uses_labels = true;
+    }
+    
+    _state[_define_id] = 2;
+    _chain.pop_back();
+}
+
+//Returns the cached value of a define, evaluating it first if it was never
+//needed or if it depends on labels and a label moved since:
+int32_t asm8::define_value(uint32_t _define_id){
+    define_t &_define = define_list[_define_id];
+    if(_define.evaluated && (!_define.uses_labels || (_define.generation == label_generation))) return _define.value;
+    if(_define.evaluating) error(ERROR_CIRCULAR_REFERENCE, _define.name + " (" + format_location(_define.first_defined) + ")");
+    
+    _define.evaluating = true;
+    try{
+        line_t _value = _define.expression;
+        for(uint32_t i = 0; i < _value.size(); i++){
+            int32_t _id;
+            if((_id = get_define_id(_value[i])) >= 0){
+                _value[i] = to_string(define_value(_id));
+            }
+            else if((_id = get_label_id(_value[i])) >= 0){
+                const label_t &_label = label_list[_id];
+                if(_label.is_extern || (object_mode && _label.relocatable))
+                    error(ERROR_RELOCATION, "label " + _label.name + " in .define " + _define.name + " can not be relocated");
+                if(!_label.placed)
+                    error(ERROR_INVALID_EXPRESSION, "label " + _label.name + " in .define " + _define.name + " (" + format_location(_define.first_defined) + ") is not placed yet");
+                _value[i] = to_string(_label.address);
+            }
+        }
+        
+        if(_value.size() == 1){
+            if(!parse_num(_value[0], _define.value))
+                error(ERROR_INVALID_EXPRESSION, _value[0] + " in .define " + _define.name + " (" + format_location(_define.first_defined) + ")");
+        }
+        else{
+            //The leading word only stands in for the instruction of a line:
+            _value.insert(_value.begin(), "(");
+            _value.insert(_value.begin(), ".define");
+            _value.push_back(")");
+            _define.value = string_to_num(evaluate_expression(_value).back());
+        }
+    }
+    catch(...){
+        _define.evaluating = false;
+        throw;
+    }
+    _define.evaluating = false;
+    _define.evaluated = true;
+    _define.generation = label_generation;
+    return _define.value;
+}
+
+//True when every label a define depends on is placed:
+bool asm8::define_ready(uint32_t _define_id){
+    const define_t &_define = define_list[_define_id];
+    if(!_define.uses_labels) return true;
+    for(uint32_t i = 0; i < _define.expression.size(); i++){
+        int32_t _id;
+        if((_id = get_define_id(_define.expression[i])) >= 0){
+            if(!define_ready(_id)) return false;
+        }
+        else if(((_id = get_label_id(_define.expression[i])) >= 0) && !label_list[_id].placed) return false;
+    }
+    return true;
+}
+
+//Walks the calls that produced the line being expanded; meeting _macro_id
+//again means the expansion would never end:
+void asm8::check_macro_recursion(const vector<uint32_t> &_expansion_macro, const vector<int32_t> &_expansion_parent, int32_t _expansion, uint32_t _macro_id){
+    bool _recursive = false;
+    for(int32_t i = _expansion; i >= 0; i = _expansion_parent[i]) _recursive |= (_expansion_macro[i] == _macro_id);
+    if(!_recursive) return;
+    
+    string _cycle = macro_list[_macro_id].name;
+    for(int32_t i = _expansion; i >= 0; i = _expansion_parent[i]){
+        _cycle = macro_list[_expansion_macro[i]].name + " (" + format_location(macro_list[_expansion_macro[i]].first_defined) + ") -> " + _cycle;
+        if(_expansion_macro[i] == _macro_id) break;
+    }
+    error(ERROR_CIRCULAR_REFERENCE, _cycle);
+}
+
+//Digits of _str[_begin.._end) in _base; false for other characters or an
+//overflow of 31 bits:
+static bool parse_digits(const string &_str, size_t _begin, size_t _end, uint32_t _base, uint32_t &_result){
+    if(_begin >= _end) return false;
+    _result = 0;
+    for(size_t i = _begin; i < _end; i++){
+        char _c = _str[i];
+        uint32_t _digit;
+        if((_c >= '0') && (_c <= '9'))      _digit = _c - '0';
+        else if((_c >= 'a') && (_c <= 'f')) _digit = _c - 'a' + 10;
+        else if((_c >= 'A') && (_c <= 'F')) _digit = _c - 'A' + 10;
+        else                                return false;
+        if(_digit >= _base) return false;
+        if(_result > (0x7FFFFFFF - _digit) / _base) return false;
+        _result = _result * _base + _digit;
+    }
+    return true;
+}
+
+//Parses decimal, hex (0x1f, $1f, 1fh), binary (0b101, %101, 101b), octal
+//(0o17, 17o, 17q) and character ('a') literals; never throws. A suffix wins
+//over a prefix when the digits fit its base, so 0b1h is hex and 0x1b is not
+//binary:
+bool asm8::parse_num(const string &_str, int32_t &_value){
+    size_t _begin = 0;
+    size_t _end = _str.length();
+    bool _negative = false;
+    uint32_t _base = 10;
+    uint32_t _result = 0;
+    
+    if(_end < 1) return false;
+    if(_str[0] == '\''){
+        if((_end != 3) || (_str[2] != '\'')) return false;
+        _value = (uint8_t)_str[1];
+        return true;
     }
-    error(ERROR_INVALID_EXPRESSION);
+    if(_str[0] == '-'){
+        _negative = true;
+        _begin = 1;
+    }
+    
+    bool _parsed = false;
+    if((_end - _begin > 1) && isdigit(_str[_begin])){
+        uint32_t _suffix = 0;
+        switch(_str[_end - 1]){
+            case 'h': _suffix = 16; break;
+            case 'b': _suffix = 2;  break;
+            case 'o':
+            case 'q': _suffix = 8;  break;
+            case 'd': _suffix = 10; break;
+        }
+        _parsed = (_suffix > 0) && parse_digits(_str, _begin, _end - 1, _suffix, _result);
+    }
+    if(!_parsed){
+        if((_end - _begin > 2) && (_str[_begin] == '0') && ((_str[_begin + 1] == 'x') || (_str[_begin + 1] == 'b') || (_str[_begin + 1] == 'o'))){
+            _base = (_str[_begin + 1] == 'x') ? 16 : ((_str[_begin + 1] == 'b') ? 2 : 8);
+            _begin += 2;
+        }
+        else if((_end - _begin > 1) && ((_str[_begin] == '$') || (_str[_begin] == '%'))){
+            _base = (_str[_begin] == '$') ? 16 : 2;
+            _begin += 1;
+        }
+        if(!parse_digits(_str, _begin, _end, _base, _result)) return false;
+    }
+    _value = _negative ? -(int32_t)_result : (int32_t)_result;
+    return true;
+}
+
+//_bits > 0 checks that the value fits into an operand of that size,
+//signed or unsigned:
+int32_t asm8::string_to_num(string _str, uint32_t _bits){
+    int32_t _value = 0;
+    if(!parse_num(_str, _value)) error(ERROR_INVALID_EXPRESSION, _str);
+    if((_bits > 0) && ((_value < -(1 << (_bits - 1))) || (_value >= (1 << _bits))))
+        error(ERROR_RANGE, to_string(_bits) + "-bit operand: " + _str);
+    return _value;
 }
 
-void asm8::do_directive(vector<string> _code){
+void asm8::do_directive(line_t _code){
     if(_code.size() < 1) return;
     if(_code[0].find(directives[include_d]) != string::npos)
         directive_include(_code);
@@ -627,13 +1081,9 @@ void asm8::do_directive(vector<string> _code){
         directive_endif(_code);
 }
 
-string asm8::directive_include(vector<string> _code){
+string asm8::directive_include(line_t _code){
     if((_code.size() > 1) && (_code[1].length() > 2)){
-        uint32_t _pathlen = current_file->filename.rfind("/");
-        string _filename = (_pathlen != string::npos) ? current_file->filename.substr(0, _pathlen + 1) : "";
-        _filename += _code[1].substr(_code[1].find('\"') + 1, (_code[1].rfind('\"') - (_code[1].find('\"') + 1)));
-        
-        open_file(_filename);
+        open_file(read8::include_path(current_file->filename, _code));
         
         return _code[1];
     }
@@ -641,35 +1091,33 @@ string asm8::directive_include(vector<string> _code){
     return "";
 }
 
-string asm8::directive_define(vector<string> _code){
-    int _value = 0;
-    _value = string_to_num(_code[2]);
-    if((_code.size() > 1) && (_code[1].size() > 0)){
-        for(uint32_t i = 0; i < define_list.size(); i++)
-            if(_code[1] == define_list[i].name) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + define_list[i].details_first_defined);
-        for(uint32_t i = 0; i < macro_list.size(); i++)
-            if(_code[1] == macro_list[i].name) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + macro_list[i].details_first_defined);
-        define_t _define(_code[1], _value, current_file->filename + ", Line " + to_string(current_file->current_line));
-        define_list.push_back(_define);
+//The value may be an expression of numbers and other defines; it is only
+//evaluated by resolve_defines() once all defines are known:
+string asm8::directive_define(line_t _code){
+    if((_code.size() > 2) && (_code[1].size() > 0)){
+        if(get_define_id(_code[1]) >= 0) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + format_location(define_list[get_define_id(_code[1])].first_defined));
+        if(get_macro_id(_code[1]) >= 0) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + format_location(macro_list[get_macro_id(_code[1])].first_defined));
+        define_ids[_code[1]] = define_list.size();
+        define_list.push_back(define_t(_code[1], 0, current_location()));
+        define_list.back().expression.assign(_code.begin() + 2, _code.end());
     }
     else error(ERROR_INVALID_EXPRESSION);
     return "";
 }
 
-string asm8::directive_macro(vector<string> _code){
+string asm8::directive_macro(line_t _code){
     if((_code.size() > 1) && (_code[1].size() > 0)){
-        for(uint32_t i = 0; i < define_list.size(); i++)
-            if(_code[1] == define_list[i].name) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + define_list[i].details_first_defined);
-        for(uint32_t i = 0; i < macro_list.size(); i++)
-            if(_code[1] == macro_list[i].name) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + macro_list[i].details_first_defined);
+        if(get_define_id(_code[1]) >= 0) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + format_location(define_list[get_define_id(_code[1])].first_defined));
+        if(get_macro_id(_code[1]) >= 0) error(ERROR_DEFINE_MACRO_ALREADY_EXISTS, _code[1] + "\nfirst defined here: " + format_location(macro_list[get_macro_id(_code[1])].first_defined));
         vector<string> _arg_list;
         for(uint32_t i = 2; i < _code.size(); i++){
             if((_code[i] != ",") && (_code[i].length() > 0)) _arg_list.push_back(_code[i]);
         }
         
+        location_t _macro_location = current_location();
         uint32_t _macro_start_line = current_file->current_line;
-        vector<vector<string>> _macro_code;
-        vector<string> _code_line;
+        vector<line_t> _macro_code;
+        line_t _code_line;
         while(!is_directive(_code_line, endm_d)){
             _code_line = split_current_line_into_words();
             current_file->current_line++;
@@ -684,8 +1132,8 @@ string asm8::directive_macro(vector<string> _code){
             if(current_file->current_line > current_file->total_lines) error(ERROR_ENDM_NOT_FOUND, _code[1] + ", line " + to_string(_macro_start_line));
         }
         
-        macro_t _macro(_code[1], _arg_list, _macro_code, current_file->filename + ", Line " + to_string(current_file->current_line));
-        macro_list.push_back(_macro);
+        macro_ids[_code[1]] = macro_list.size();
+        macro_list.push_back(macro_t(_code[1], move(_arg_list), move(_macro_code), _macro_location));
         
 //        //DEBUG
 //        cout << "  Macro Name:\t" << _macro.name <<
@@ -699,30 +1147,93 @@ string asm8::directive_macro(vector<string> _code){
     return "";
 }
 
-string asm8::directive_endm(vector<string> _code){
+string asm8::directive_endm(line_t _code){
+    return "";
+}
+
+string asm8::directive_if(line_t _code){
+    return "";
+}
+
+string asm8::directive_endif(line_t _code){
+    return "";
+}
+
+string asm8::directive_global(line_t _code){
+    if((_code.size() < 2) || (_code[1].size() < 1)) error(ERROR_INVALID_EXPRESSION);
+    for(uint32_t i = 1; i < _code.size(); i++) if(_code[i] != ",") global_list.push_back(_code[i]);
     return "";
 }
 
-string asm8::directive_if(vector<string> _code){
+string asm8::directive_extern(line_t _code){
+    if((_code.size() < 2) || (_code[1].size() < 1)) error(ERROR_INVALID_EXPRESSION);
+    for(uint32_t i = 1; i < _code.size(); i++){
+        if(_code[i] == ",") continue;
+        line_t _label;
+        _label.push_back(_code[i] + string(":"));
+        add_label(_label);
+        label_list.back().is_extern = true;
+    }
     return "";
 }
 
-string asm8::directive_endif(vector<string> _code){
+//".section name" switches to a section, ".section" alone back to the code
+//outside of sections. The first one that gives an address fixes it there,
+//".section name, start, end" lets it go anywhere in start..end instead.
+//Pass 2 lays every section out from 0, place_sections() moves it:
+string asm8::directive_section(line_t _code, uint32_t &_address, uint32_t &_label_pc){
+    if(streaming || object_mode) error(ERROR_SECTION, "sections need the whole program, they can not be used with --stream or -c");
+    vector<line_t> _operands = split_operands(_code);
+    if((_operands.size() > 3) || ((_operands.size() > 0) && (_operands[0].size() != 1))) error(ERROR_INVALID_EXPRESSION);
+    
+    int32_t _id = -1;
+    if(_operands.size() > 0){
+        _id = get_section_id(_operands[0][0]);
+        if(_id < 0){
+            _id = section_list.size();
+            section_list.push_back(code_section_t(_operands[0][0], current_location()));
+        }
+    }
+    if(_operands.size() > 1){
+        code_section_t &_section = section_list[_id];
+        bool _fixed = (_operands.size() == 2);
+        uint32_t _start = evaluate_operand(_operands[1]);
+        uint32_t _end = _fixed ? _start : evaluate_operand(_operands[2]);
+        if((_start > _end) || (_end >= LINK8_MEMORY_SIZE)) error(ERROR_SECTION, "placement of " + _section.name + " is out of memory");
+        if(_section.has_rule && ((_section.fixed != _fixed) || (_section.start != _start) || (_section.end != _end)))
+            error(ERROR_SECTION, "placement of " + _section.name + " given twice, first in " + format_location(_section.first_defined));
+        _section.has_rule = true;
+        _section.fixed = _fixed;
+        _section.start = _start;
+        _section.end = _fixed ? (LINK8_MEMORY_SIZE - 1) : _end;
+    }
+    
+    if(current_section >= 0){
+        section_list[current_section].address = _address;
+        section_list[current_section].label_pc = _label_pc;
+    }
+    else{
+        outside_address = _address;
+        outside_label_pc = _label_pc;
+    }
+    current_section = _id;
+    _address = (_id >= 0) ? section_list[_id].address : outside_address;
+    _label_pc = (_id >= 0) ? section_list[_id].label_pc : outside_label_pc;
     return "";
 }
 
-string asm8::directive_dsb(vector<string> _code, uint32_t _addr){
+string asm8::directive_dsb(line_t _code, uint32_t _addr){
     if(_code.size() < 3) error(ERROR_INVALID_EXPRESSION);
-    vector<string> _label;
+    line_t _label;
     _label.push_back(_code[1] + string(":"));
     add_label(_label);
     set_label_addr(get_label_id(_label), _addr);
     return "";
 }
 
-void asm8::skip_directive_macro(vector<string> _code){
+void asm8::skip_directive_macro(line_t _code){
     uint32_t _macro_start_line = current_file->current_line;
-    vector<string> _code_line = split_current_line_into_words();
+    line_t _code_line = split_current_line_into_words();
     while(!is_directive(_code_line, endm_d)){
         _code_line = split_current_line_into_words();
         current_file->current_line++;
@@ -731,58 +1242,183 @@ void asm8::skip_directive_macro(vector<string> _code){
     }
 }
 
-void asm8::skip_directive_if(vector<string> _code){
+void asm8::skip_directive_if(line_t _code){
     
 }
 
-uint32_t asm8::get_db_size(vector<string> _code){
+//Every operand is one byte, or the characters of a string:
+uint32_t asm8::get_db_size(line_t _code){
     if(_code.size() < 2) return 0;
     uint32_t _count = 0;
-    for(uint32_t i = 1; i < _code.size(); i++){
-        if(_code[i][0] == '\"'){
-            for(uint32_t j = 1; j < _code[i].size(); j++){
-                if(_code[i][j] == '\"') break;
-                else                    _count++;
+    vector<line_t> _operands = split_operands(_code);
+    for(uint32_t i = 0; i < _operands.size(); i++){
+        if(_operands[i][0][0] == '\"'){
+            for(uint32_t j = 1; j < _operands[i][0].size(); j++){
+                if(_operands[i][0][j] == '\"') break;
+                else                            _count++;
             }
         }
-        else if(_code[i] != ",") _count++;
+        else _count++;
     }
     
     return _count;
 }
 
-uint32_t asm8::get_dsb_size(vector<string> _code){
+uint32_t asm8::get_dsb_size(line_t _code){
     if(_code.size() < 3) return 0;
     return string_to_num(_code[2]);
 }
 
-int32_t asm8::get_label_id(vector<string> _code){
-    for(uint32_t i = 0; i < label_list.size(); i++){
-        for(uint32_t j = 0; j < _code.size(); j++){
-            if(_code[j].substr(0, _code[j].find(":")) == label_list[i].name) return i;
+//Bytes emitted by .db, .dw and .fill:
+uint32_t asm8::get_data_size(line_t _code){
+    if(is_directive(_code, db_d)) return get_db_size(_code);
+    if(is_directive(_code, dw_d)) return 2 * split_operands(_code).size();
+    if(is_directive(_code, fill_d)){
+        vector<line_t> _operands = split_operands(_code);
+        if(_operands.size() < 1) error(ERROR_INVALID_EXPRESSION, ".fill requires a count");
+        int32_t _count = evaluate_operand(_operands[0], 16);
+        if(_count < 0) error(ERROR_RANGE, ".fill count: " + to_string(_count));
+        return _count;
+    }
+    return 0;
+}
+
+//Splits the operands of a directive at the commas outside of parentheses:
+vector<line_t> asm8::split_operands(const line_t &_code){
+    vector<line_t> _operands;
+    line_t _operand;
+    int32_t _depth = 0;
+    for(uint32_t i = 1; i < _code.size(); i++){
+        if(_code[i] == "(")         _depth++;
+        else if(_code[i] == ")")    _depth--;
+        if((_code[i] == ",") && (_depth == 0)){
+            if(_operand.size() > 0) _operands.push_back(_operand);
+            _operand.clear();
+        }
+        else _operand.push_back(_code[i]);
+    }
+    if(_operand.size() > 0) _operands.push_back(_operand);
+    return _operands;
+}
+
+int32_t asm8::evaluate_operand(line_t _operand, uint32_t _bits){
+    _operand = insert_label(insert_define(_operand));
+    if(_operand.size() == 1) return string_to_num(_operand[0], _bits);
+    _operand.insert(_operand.begin(), "(");
+    _operand.push_back(")");
+    return string_to_num(evaluate_expression(_operand).back(), _bits);
+}
+
+//Index of the .endr closing the .rept at _rept, -1 if there is none:
+int32_t asm8::find_endr(const vector<line_t> &_lines, uint32_t _rept){
+    int32_t _depth = 0;
+    for(uint32_t i = _rept; i < _lines.size(); i++){
+        if(is_directive(_lines[i], rept_d)) _depth++;
+        else if(is_directive(_lines[i], endr_d)){
+            _depth--;
+            if(_depth == 0) return i;
+        }
+    }
+    return -1;
+}
+
+//.rept count[, variable]; the variable counts from 0 in every iteration:
+void asm8::get_rept_args(const line_t &_code, uint32_t &_count, string &_var){
+    vector<line_t> _operands = split_operands(_code);
+    if(_operands.size() < 1) error(ERROR_REPT, ".rept requires a count");
+    int32_t _value = evaluate_operand(_operands[0], 16);
+    if(_value < 0) error(ERROR_RANGE, ".rept count: " + to_string(_value));
+    _count = _value;
+    _var = ((_operands.size() > 1) && (_operands[1].size() == 1)) ? _operands[1][0] : "";
+}
+
+vector<line_t> asm8::get_rept_iteration(const vector<line_t> &_block, uint32_t _index){
+    uint32_t _count;
+    string _var;
+    get_rept_args(_block[0], _count, _var);
+    vector<line_t> _body(_block.begin() + 1, _block.end() - 1);
+    if(_var == "") return _body;
+    string _value = to_string(_index);
+    for(uint32_t i = 0; i < _body.size(); i++)
+        for(uint32_t j = 0; j < _body[i].size(); j++)
+            if(_body[i][j] == _var) _body[i][j] = _value;
+    return _body;
+}
+
+//Without a variable every iteration has the same size, so only the first
+//one is measured:
+uint32_t asm8::get_rept_size(const vector<line_t> &_block){
+    uint32_t _count;
+    string _var;
+    get_rept_args(_block[0], _count, _var);
+    
+    uint32_t _size = 0;
+    uint32_t _measured = ((_var == "") && (_count > 0)) ? 1 : _count;
+    for(uint32_t k = 0; k < _measured; k++){
+        vector<line_t> _body = get_rept_iteration(_block, k);
+        for(uint32_t i = 0; i < _body.size(); i++){
+            if(is_directive(_body[i], rept_d)){
+                int32_t _end = find_endr(_body, i);
+                if(_end < 0) error(ERROR_REPT, "missing .endr");
+                _size += get_rept_size(vector<line_t>(_body.begin() + i, _body.begin() + _end + 1));
+                i = _end;
+            }
+            else if(is_directive(_body[i], any_d))  _size += get_data_size(_body[i]);
+            else if(check_instr_valid(_body[i]))    _size += get_instr_size(_body[i]);
         }
     }
+    if(_measured < _count) _size *= _count;
+    return _size;
+}
+
+int32_t asm8::get_label_id(line_t _code){
+    int32_t _label_id;
+    for(uint32_t i = 0; i < _code.size(); i++){
+        if((_label_id = get_label_id(_code[i].substr(0, _code[i].find(":")))) >= 0) return _label_id;
+    }
+    return -1;
+}
+
+int32_t asm8::get_label_id(const string &_name){
+    unordered_map<string, uint32_t>::const_iterator _it = label_ids.find(_name);
+    return (_it != label_ids.end()) ? (int32_t)_it->second : -1;
+}
+
+int32_t asm8::get_define_id(const string &_name){
+    unordered_map<string, uint32_t>::const_iterator _it = define_ids.find(_name);
+    return (_it != define_ids.end()) ? (int32_t)_it->second : -1;
+}
+
+int32_t asm8::get_macro_id(const string &_name){
+    unordered_map<string, uint32_t>::const_iterator _it = macro_ids.find(_name);
+    return (_it != macro_ids.end()) ? (int32_t)_it->second : -1;
+}
+
+int32_t asm8::get_section_id(const string &_name){
+    for(uint32_t i = 0; i < section_list.size(); i++) if(section_list[i].name == _name) return i;
     return -1;
 }
 
 void asm8::set_label_addr(uint32_t _label_id, uint32_t _addr){
+    if(!label_list[_label_id].placed || (label_list[_label_id].address != _addr)) label_generation++;
     label_list[_label_id].address = _addr;
+    label_list[_label_id].relocatable = relocatable_pc;
+    label_list[_label_id].placed = true;
 }
 
-int asm8::get_define_value(vector<string> _code){
+int asm8::get_define_value(line_t _code){
+    int32_t _define_id;
     for(uint32_t i = 0; i < _code.size(); i++){
-        for(uint32_t j = 0; j < define_list.size(); j++){
-            if(_code[i] == define_list[j].name) return define_list[j].value;
-        }
+        if((_define_id = get_define_id(_code[i])) >= 0) return define_value(_define_id);
     }
     return 0;
 }
 
-string asm8::get_macro(vector<string> _code){
+string asm8::get_macro(line_t _code){
     return "";
 }
 
-asm8::instr_type asm8::get_instr_type(vector<string> _code){
+asm8::instr_type asm8::get_instr_type(line_t _code){
     if(_code.size() < 1)            return empty_instr;
     if(_code[0].size() < 1)         return empty_instr;
     if(is_directive(_code, any_d))  return empty_instr;
@@ -802,7 +1438,7 @@ asm8::instr_type asm8::get_instr_type(vector<string> _code){
     if(_code[0].find("rar") == 0)   return rar_instr;
     
     if(_code[0].find("halt") == 0)  return halt_instr;
-    if(_code[0].find("nop") == 0)   return xor_instr;
+    if(_code[0].find("nop") == 0)   return nop_instr;
     if(_code[0].find("l") == 0)     return ld_instr;
     
     if(_code[0].find("rst") == 0)   return rst_instr;
@@ -818,7 +1454,7 @@ asm8::instr_type asm8::get_instr_type(vector<string> _code){
     return invalid_instr;
 }
 
-bool asm8::check_instr_valid(vector<string> _code){
+bool asm8::check_instr_valid(line_t _code){
     switch(get_instr_type(_code)){
         case add_instr:
         case adc_instr:
@@ -873,7 +1509,7 @@ bool asm8::check_instr_valid(vector<string> _code){
     }
 }
 
-uint8_t asm8::get_instr_size(vector<string> _code){
+uint8_t asm8::get_instr_size(line_t _code){
     switch(get_instr_type(_code)){
         case add_instr:
         case adc_instr:
@@ -922,7 +1558,60 @@ uint8_t asm8::get_instr_size(vector<string> _code){
     }
 }
 
-vector<uint8_t> asm8::translate_instr(vector<string> _code){
+//T-states per instruction as given in the 8008 datasheet; conditional jumps,
+//calls and returns take fewer states when the condition is not met:
+uint8_t asm8::get_instr_cycles(line_t _code, bool _taken){
+    switch(get_instr_type(_code)){
+        case add_instr:
+        case adc_instr:
+        case sub_instr:
+        case sbc_instr:
+        case and_instr:
+        case xor_instr:
+        case or_instr:
+        case cp_instr:
+            if((_code[0].substr(2, 1) == "i") || (_code[0].substr(2, 1) == "m")) return 8;
+            else                                                                return 5;
+        case halt_instr:
+            return 4;
+        case nop_instr:
+            return 5;
+        case ld_instr:
+            if(_code[0].substr(2, 1) == "i")        return (_code[0].substr(1, 1) == "m") ? 9 : 8;
+            else if(_code[0].substr(1, 1) == "m")   return 7;
+            else if(_code[0].substr(2, 1) == "m")   return 8;
+            else                                    return 5;
+        case rlc_instr:
+        case ral_instr:
+        case rrc_instr:
+        case rar_instr:
+            return 5;
+        case ret_instr:
+            if(_code[0] == "ret")   return 5;
+            else                    return _taken ? 5 : 3;
+        case rst_instr:
+            return 5;
+        case jmp_instr:
+            if(_code[0] == "jmp")   return 11;
+            else                    return _taken ? 11 : 9;
+        case cal_instr:
+            if(_code[0] == "cal")   return 11;
+            else                    return _taken ? 11 : 9;
+        case inp_instr:
+            return 8;
+        case out_instr:
+            return 6;
+        case inc_instr:
+        case dec_instr:
+            return 5;
+        case empty_instr:
+        case invalid_instr:
+        default:
+            return 0;
+    }
+}
+
+vector<uint8_t> asm8::translate_instr(line_t _code){
     vector<uint8_t> _translated_code;
     uint8_t _byte;
     uint16_t _word;
@@ -933,23 +1622,37 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             uint32_t _org;
             _org = string_to_num(_code[1]);
             while(_addr < _org){
-                _translated_code.push_back(0xFF);
+                _translated_code.push_back(org_fill);
                 _addr++;
             }
         }
         else if(is_directive(_code, db_d)){
-            for(uint32_t i = 1; i < _code.size(); i++){
-                if(_code[i][0] == '\"'){
-                    for(uint32_t j = 1; (j < _code[i].size()); j++){
-                        if((_code[i][j] == '\"')) break;
-                        _translated_code.push_back(string_to_num(string("\'") + _code[i][j] + string("\'")));
+            vector<line_t> _operands = split_operands(_code);
+            for(uint32_t i = 0; i < _operands.size(); i++){
+                if(_operands[i][0][0] == '\"'){
+                    for(uint32_t j = 1; (j < _operands[i][0].size()); j++){
+                        if((_operands[i][0][j] == '\"')) break;
+                        _translated_code.push_back(_operands[i][0][j]);
                     }
                 }
-                else if(isdigit(_code[i][0])){
-                    _translated_code.push_back(string_to_num(_code[i]));
+                else{
+                    _translated_code.push_back(evaluate_operand(_operands[i], 8));
                 }
             }
         }
+        else if(is_directive(_code, dw_d)){
+            vector<line_t> _operands = split_operands(_code);
+            for(uint32_t i = 0; i < _operands.size(); i++){
+                _word = evaluate_operand(_operands[i], 16);
+                _translated_code.push_back(_word & 0xFF);
+                _translated_code.push_back((_word >> 8) & 0xFF);
+            }
+        }
+        else if(is_directive(_code, fill_d)){
+            vector<line_t> _operands = split_operands(_code);
+            _byte = (_operands.size() > 1) ? evaluate_operand(_operands[1], 8) : 0;
+            _translated_code.insert(_translated_code.end(), get_data_size(_code), _byte);
+        }
         
         return _translated_code;
     }
@@ -968,7 +1671,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x04);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -984,7 +1687,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x0C);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1000,7 +1703,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x14);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1016,7 +1719,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x1C);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1032,7 +1735,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x24);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1048,7 +1751,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x2C);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1064,7 +1767,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x34);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1080,7 +1783,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             else if(_code[0].substr(2, 1) == "m")   _byte |= 0x07;
             else if(_code[0].substr(2, 1) == "i"){
                 _translated_code.push_back(0x3C);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1089,6 +1792,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
             break;
         case nop_instr:
             _translated_code.push_back(0xC0);
+            break;
         case ld_instr:
             if(_code[0].substr(2, 1) != "i"){
                 _byte = 0xC0;
@@ -1119,7 +1823,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
                 else if(_code[0].substr(1, 1) == "l")   _byte = 0x36;
                 else if(_code[0].substr(1, 1) == "m")   _byte = 0x3E;
                 _translated_code.push_back(_byte);
-                _byte = string_to_num(_code[1]);
+                _byte = string_to_num(_code[1], 8);
             }
             _translated_code.push_back(_byte);
             break;
@@ -1147,12 +1851,9 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
                 if(_code[0].substr(1, 1) == "t") _byte += 0x20;
                 _translated_code.push_back(_byte);
             }
-            _word = string_to_num(_code[1]);
-            _translated_code.push_back(_word & 0xFF);
-            _translated_code.push_back((_word >> 8) & 0xFF);
             break;
         case rst_instr:
-            _byte = string_to_num(_code[1]);
+            _byte = string_to_num(_code[1], 8);
             if(_byte > 7) error(ERROR_INVALID_INSTR);
             _byte = 0x05 + (_byte << 3);
             _translated_code.push_back(_byte);
@@ -1169,7 +1870,7 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
                 if(_code[0].substr(1, 1) == "t") _byte += 0x20;
                 _translated_code.push_back(_byte);
             }
-            _word = string_to_num(_code[1]);
+            _word = string_to_num(_code[1], 16);
             _translated_code.push_back(_word & 0xFF);
             _translated_code.push_back((_word >> 8) & 0xFF);
             break;
@@ -1185,18 +1886,18 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
                 if(_code[0].substr(1, 1) == "t") _byte += 0x20;
                 _translated_code.push_back(_byte);
             }
-            _word = string_to_num(_code[1]);
+            _word = string_to_num(_code[1], 16);
             _translated_code.push_back(_word & 0xFF);
             _translated_code.push_back((_word >> 8) & 0xFF);
             break;
         case inp_instr:
-            _byte = string_to_num(_code[1]);
+            _byte = string_to_num(_code[1], 8);
             if(_byte > 7) error(ERROR_INVALID_INSTR);
             _byte = 0x41 + (_byte << 1);
             _translated_code.push_back(_byte);
             break;
         case out_instr:
-            _byte = string_to_num(_code[1]);
+            _byte = string_to_num(_code[1], 8);
             if((_byte < 8) || (_byte > 31)) error(ERROR_INVALID_INSTR);
             _byte = 0x41 + (_byte << 1);
             _translated_code.push_back(_byte);
@@ -1229,11 +1930,934 @@ vector<uint8_t> asm8::translate_instr(vector<string> _code){
     return _translated_code;
 }
 
+//Appends a byte to the image; populated bytes are tracked as segments for the
+//record output formats:
+void asm8::emit_byte(uint8_t _byte, bool _populated){
+    if(_populated) out8::add_byte(segments, binary_out.size());
+    binary_out.push_back(_byte);
+    address++;
+}
+
+//Lists, times and encodes one expanded line at the current address. In
+//streaming mode labels that are not placed yet encode as 0 and are patched
+//by resolve_fixups() once pass 2 is through:
+void asm8::encode_line(line_t &_code, bool _list){
+    if(_code.size() < 1) return;
+    
+    uint8_t _cycles_min = get_instr_cycles(_code, false);
+    uint8_t _cycles_max = get_instr_cycles(_code, true);
+    
+    char _buf[32];
+    char _cycles_buf[16] = "";
+    if(_cycles_min != _cycles_max)  sprintf(_cycles_buf, "%d/%d", _cycles_min, _cycles_max);
+    else if(_cycles_max > 0)        sprintf(_cycles_buf, "%d", _cycles_max);
+    sprintf(_buf, "0x%04X: %5s\t", address, _cycles_buf);
+    if(_list){
+        cout << _buf;
+        for(uint32_t j = 0; j < _code.size(); j++) cout << _code[j] << " ";
+        cout << endl;
+    }
+    
+    //Accumulate T-states for the current routine and all open timing spans:
+    if(is_label(_code)){
+        routine_timing_list.push_back(timing_t(_code[0].substr(0, _code[0].find(":")), address));
+    }
+    else if(is_directive(_code, timing_d)){
+        if(_code.size() < 2) error(ERROR_TIMING_SPAN, ".timing requires a name");
+        span_timing_list.push_back(timing_t(_code[1], address));
+        open_spans.push_back(span_timing_list.size() - 1);
+    }
+    else if(is_directive(_code, endtiming_d)){
+        if(open_spans.size() < 1) error(ERROR_TIMING_SPAN, ".endtiming without .timing");
+        open_spans.pop_back();
+    }
+    else{
+        if(routine_timing_list.size() > 0){
+            routine_timing_list.back().cycles_min += _cycles_min;
+            routine_timing_list.back().cycles_max += _cycles_max;
+        }
+        for(uint32_t j = 0; j < open_spans.size(); j++){
+            span_timing_list[open_spans[j]].cycles_min += _cycles_min;
+            span_timing_list[open_spans[j]].cycles_max += _cycles_max;
+        }
+    }
+    
+    //Object output: every .org starts a new absolute section:
+    if(object_mode && is_directive(_code, org_d)){
+        object.sections.back().data.assign(binary_out.begin() + object.sections.back().base, binary_out.end());
+        object.sections.push_back(section_t("abs", true, string_to_num(_code[1])));
+    }
+    
+    int32_t _reloc_label = object_mode ? get_reloc_label(_code) : -1;
+    int32_t _fixup_label = streaming ? get_fixup_label(_code) : -1;
+    line_t _unresolved = _code;
+    uint32_t _instr_address = address;
+    
+    if(contains_define(_code)){
+        //Like a label that is not placed yet, a define waiting for one encodes as 0:
+        for(uint32_t j = 0; streaming && (j < _code.size()); j++){
+            int32_t _define_id = get_define_id(_code[j]);
+            if((_define_id >= 0) && !define_ready(_define_id)) _code[j] = "0";
+        }
+        _code = insert_define(_code);
+    }
+    if(contains_label(_code)){
+        _code = insert_label(_code);
+    }
+    //Data directives evaluate each of their operands on their own:
+    if(contains_expression(_code) && !is_directive(_code, db_d) && !is_directive(_code, dw_d) && !is_directive(_code, fill_d)){
+        _code = evaluate_expression(_code);
+    }
+    vector<uint8_t> _translated_code = translate_instr(_code);
+    //.org padding is not part of any segment:
+    bool _populated = !is_directive(_code, org_d);
+    for(uint32_t j = 0; j < _translated_code.size(); j++) emit_byte(_translated_code[j], _populated);
+    
+    //Size report: every populated byte counts for its file, the label span it
+    //is in and the macro whose body it came from:
+    if(is_label(_code)) span_label = get_label_id(_code);
+    if(_populated && (_translated_code.size() > 0) && (size_report_file != "")){
+        if(file_bytes.size() < file_table.size())   file_bytes.resize(file_table.size(), 0);
+        if(label_bytes.size() <= label_list.size()) label_bytes.resize(label_list.size() + 1, 0);
+        if(macro_bytes.size() < macro_list.size())  macro_bytes.resize(macro_list.size(), 0);
+        if(encode_source.file_id < file_bytes.size()) file_bytes[encode_source.file_id] += _translated_code.size();
+        label_bytes[span_label + 1] += _translated_code.size();
+        if(encode_macro >= 0) macro_bytes[encode_macro] += _translated_code.size();
+    }
+    
+    //Address to source line table for the map files; bytes of one source line
+    //that follow each other share an entry:
+    if(_populated && (_translated_code.size() > 0) && ((map_file != "") || (map_binary_file != ""))){
+        if((line_map.size() > 0) && (line_map.back().file_id == encode_source.file_id) && (line_map.back().line == encode_source.line) &&
+           (line_map.back().address + line_map.back().size == _instr_address))
+            line_map.back().size += _translated_code.size();
+        else line_map.push_back(map_line_t(_instr_address, _translated_code.size(), "", encode_source.file_id, encode_source.line));
+    }
+    
+    if(_reloc_label >= 0) object.relocs.push_back(make_reloc(_unresolved, _reloc_label, _instr_address));
+    //A plain 8-bit value still needs its range checked, so that line is kept too:
+    if(_fixup_label >= 0){
+        reloc_t _fixup = make_reloc(_unresolved, _fixup_label, _instr_address);
+        if((_fixup.type != reloc_t::reloc_lo8) || (find(_unresolved.begin(), _unresolved.end(), "<") != _unresolved.end()))
+            fixups.push_back(_fixup);
+        else _fixup_label = -2;
+    }
+    if(_fixup_label == -2) fixup_lines.push_back(fixup_line_t(_instr_address, current_location(), _unresolved));
+}
+
+//Encodes _lines[_line], or the whole .rept block starting there, and returns
+//the index of the last line it used:
+uint32_t asm8::encode_at(vector<line_t> &_lines, uint32_t _line){
+    if(!is_directive(_lines[_line], rept_d)){
+        encode_line(_lines[_line]);
+        return _line;
+    }
+    int32_t _end = find_endr(_lines, _line);
+    if(_end < 0) error(ERROR_REPT, "missing .endr");
+    encode_rept(vector<line_t>(_lines.begin() + _line, _lines.begin() + _end + 1), true);
+    return _end;
+}
+
+//Every iteration is encoded straight into the image; only the first one is
+//listed:
+void asm8::encode_rept(const vector<line_t> &_block, bool _list){
+    uint32_t _count;
+    string _var;
+    get_rept_args(_block[0], _count, _var);
+    
+    line_t _line = _block[0];
+    encode_line(_line, _list);
+    for(uint32_t k = 0; k < _count; k++){
+        vector<line_t> _body = get_rept_iteration(_block, k);
+        for(uint32_t i = 0; i < _body.size(); i++){
+            if(is_directive(_body[i], rept_d)){
+                int32_t _end = find_endr(_body, i);
+                encode_rept(vector<line_t>(_body.begin() + i, _body.begin() + _end + 1), _list && (k == 0));
+                i = _end;
+            }
+            else encode_line(_body[i], _list && (k == 0));
+        }
+    }
+    _line = _block.back();
+    encode_line(_line, _list);
+}
+
+//Returns the one label of a line that is not placed yet, -1 if there is
+//none and -2 if there are several or a define waits for a label, so the
+//whole line has to be kept:
+int32_t asm8::get_fixup_label(line_t _code){
+    if(is_label(_code)) return -1;
+    int32_t _label_id = -1;
+    for(uint32_t i = 0; i < _code.size(); i++){
+        int32_t _define_id = get_define_id(_code[i]);
+        if((_define_id >= 0) && !define_ready(_define_id)) return -2;
+        int32_t j = get_label_id(_code[i]);
+        if((j < 0) || label_list[j].placed) continue;
+        if((_label_id >= 0) && (_label_id != j)) return -2;
+        _label_id = j;
+    }
+    return _label_id;
+}
+
+void asm8::resolve_fixups(){
+    for(uint32_t i = 0; i < fixups.size(); i++){
+        try{
+            if(!label_list[fixups[i].symbol].placed) error(ERROR_INVALID_EXPRESSION, "label " + label_list[fixups[i].symbol].name + " is never placed");
+            fixups[i].apply(binary_out, fixups[i].offset, label_list[fixups[i].symbol].address);
+        }
+        catch(const assembly_error_t &){}
+    }
+    
+    uint32_t _address = address;
+    for(uint32_t i = 0; i < fixup_lines.size(); i++){
+        encode_source = fixup_lines[i].location;
+        try{
+            for(uint32_t j = 0; j < fixup_lines[i].code.size(); j++){
+                int32_t _label_id = get_label_id(fixup_lines[i].code[j]);
+                if((_label_id >= 0) && !label_list[_label_id].placed)
+                    error(ERROR_INVALID_EXPRESSION, "label " + label_list[_label_id].name + " is never placed");
+            }
+            address = fixup_lines[i].address;
+            line_t _code = insert_label(insert_define(fixup_lines[i].code));
+            if(contains_expression(_code)) _code = evaluate_expression(_code);
+            vector<uint8_t> _translated_code = translate_instr(_code);
+            for(uint32_t j = 0; j < _translated_code.size(); j++) binary_out[fixup_lines[i].address + j] = _translated_code[j];
+        }
+        catch(const assembly_error_t &){}
+    }
+    address = _address;
+}
+
+//Returns the relocatable or external label a line refers to, -1 if none:
+int32_t asm8::get_reloc_label(line_t _code){
+    if(is_label(_code) || (is_directive(_code, any_d) && !is_directive(_code, db_d) && !is_directive(_code, dw_d))) return -1;
+    int32_t _label_id = -1;
+    for(uint32_t i = 0; i < _code.size(); i++){
+        int32_t j = get_label_id(_code[i]);
+        if((j < 0) || !(label_list[j].relocatable || label_list[j].is_extern)) continue;
+        if((_label_id >= 0) && (_label_id != j)) error(ERROR_RELOCATION, "more than one relocatable label in expression");
+        _label_id = j;
+    }
+    return _label_id;
+}
+
+//Records where the label's value ended up in the encoded bytes at _addr,
+//with the addend being whatever the expression added to the label. The
+//offset is absolute; object output makes it relative to the section:
+reloc_t asm8::make_reloc(line_t _code, int32_t _label_id, uint32_t _addr){
+    uint32_t _offset = 0;
+    uint8_t _type = reloc_t::reloc_word;
+    int32_t _addend = 0;
+    uint16_t _value = label_list[_label_id].address;
+    
+    if(is_directive(_code, db_d)){
+        vector<line_t> _operands = split_operands(_code);
+        for(uint32_t i = 0; (i < _operands.size()) && (find(_operands[i].begin(), _operands[i].end(), label_list[_label_id].name) == _operands[i].end()); i++){
+            _operands[i].insert(_operands[i].begin(), ".db");
+            _offset += get_db_size(_operands[i]);
+        }
+        _type = reloc_t::reloc_lo8;
+        for(uint32_t i = 1; (i < _code.size()) && (_code[i] != label_list[_label_id].name); i++)
+            if(_code[i] == ">") _type = reloc_t::reloc_hi8;
+    }
+    else if(is_directive(_code, dw_d)){
+        vector<line_t> _operands = split_operands(_code);
+        for(uint32_t i = 0; (i < _operands.size()) && (find(_operands[i].begin(), _operands[i].end(), label_list[_label_id].name) == _operands[i].end()); i++)
+            _offset += 2;
+        _type = reloc_t::reloc_word;
+    }
+    else if(get_instr_size(_code) == 3){
+        _offset = 1;
+        _type = reloc_t::reloc_word;
+    }
+    else if(get_instr_size(_code) == 2){
+        _offset = 1;
+        _type = reloc_t::reloc_lo8;
+        for(uint32_t i = 1; (i < _code.size()) && (_code[i] != label_list[_label_id].name); i++)
+            if(_code[i] == ">") _type = reloc_t::reloc_hi8;
+    }
+    else error(ERROR_RELOCATION, "label " + label_list[_label_id].name + " can not be relocated here");
+    
+    _addr += _offset;
+    if(_type == reloc_t::reloc_word)        _addend = (binary_out[_addr] | (binary_out[_addr + 1] << 8)) - _value;
+    else if(_type == reloc_t::reloc_lo8)    _addend = binary_out[_addr] - (_value & 0xFF);
+    else                                    _addend = binary_out[_addr] - ((_value >> 8) & 0xFF);
+    
+    if(!object_mode) return reloc_t(0, _addr, _type, _label_id, _addend);
+    return reloc_t(object.sections.size() - 1, _addr - object.sections.back().base, _type, _label_id, _addend);
+}
+
+//Symbols are numbered labels first, then defines, then macros; a use refers
+//to its symbol as kind << 24 | id until then:
+int asm8::write_xref(){
+    xref8 _xref;
+    _xref.files = file_table;
+    uint32_t _first[3] = {0, (uint32_t)label_list.size(), (uint32_t)(label_list.size() + define_list.size())};
+    for(uint32_t i = 0; i < label_list.size(); i++)
+        _xref.symbols.push_back(xref_symbol_t(label_list[i].name, xref_symbol_t::symbol_label, label_list[i].first_defined.file_id, label_list[i].first_defined.line));
+    for(uint32_t i = 0; i < define_list.size(); i++)
+        _xref.symbols.push_back(xref_symbol_t(define_list[i].name, xref_symbol_t::symbol_define, define_list[i].first_defined.file_id, define_list[i].first_defined.line));
+    for(uint32_t i = 0; i < macro_list.size(); i++)
+        _xref.symbols.push_back(xref_symbol_t(macro_list[i].name, xref_symbol_t::symbol_macro, macro_list[i].first_defined.file_id, macro_list[i].first_defined.line));
+    for(uint32_t i = 0; i < xref_uses.size(); i++)
+        _xref.uses.push_back(xref_use_t(_first[xref_uses[i].symbol >> 24] + (xref_uses[i].symbol & 0xFFFFFF), xref_uses[i].file_id, xref_uses[i].line));
+    
+    if(_xref.write(xref_file) != 0) return error(ERROR_CREATE_FILE, xref_file);
+    cout << "Cross-reference index saved to: " << xref_file << endl;
+    return 0;
+}
+
+//Labels and defines keep the location they were first defined at:
+int asm8::write_map(){
+    map8 _map;
+    _map.files = file_table;
+    for(uint32_t i = 0; i < label_list.size(); i++){
+        if(label_list[i].is_extern) continue;
+        _map.symbols.push_back(map_symbol_t(label_list[i].name, label_list[i].address, map_symbol_t::symbol_label, label_list[i].first_defined.file_id, label_list[i].first_defined.line));
+    }
+    for(uint32_t i = 0; i < define_list.size(); i++)
+        _map.symbols.push_back(map_symbol_t(define_list[i].name, (uint32_t)define_value(i), map_symbol_t::symbol_define, define_list[i].first_defined.file_id, define_list[i].first_defined.line));
+    _map.lines = line_map;
+    _map.expansions = expansion_sites;
+    _map.sort();
+    
+    if((map_file != "") && (_map.write_text(map_file) != 0)) return error(ERROR_CREATE_FILE, map_file);
+    if((map_binary_file != "") && (_map.write_binary(map_binary_file) != 0)) return error(ERROR_CREATE_FILE, map_binary_file);
+    if(map_file != "")          cout << "Map saved to: " << map_file << endl;
+    if(map_binary_file != "")   cout << "Binary map saved to: " << map_binary_file << endl;
+    return 0;
+}
+
+static string json_string(const string &_str){
+    string _out = "\"";
+    for(uint32_t i = 0; i < _str.length(); i++){
+        if((_str[i] == '\"') || (_str[i] == '\\')) _out += '\\';
+        if((uint8_t)_str[i] < 0x20) continue;
+        _out += _str[i];
+    }
+    return _out + "\"";
+}
+
+static bool size_entry_larger(const pair<string, uint32_t> &_a, const pair<string, uint32_t> &_b){
+    return _a.second > _b.second;
+}
+
+//Prints the byte counts largest first and writes them as JSON (- for stdout);
+//bytes before the first label belong to the "(start)" span:
+int asm8::write_size_report(string _filename){
+    vector<pair<string, uint32_t>> _files, _spans, _macros;
+    uint32_t _total = 0;
+    for(uint32_t i = 0; i < file_bytes.size(); i++){
+        _total += file_bytes[i];
+        if(file_bytes[i] > 0) _files.push_back(make_pair(file_table[i], file_bytes[i]));
+    }
+    for(uint32_t i = 0; i < label_bytes.size(); i++)
+        if(label_bytes[i] > 0) _spans.push_back(make_pair((i > 0) ? label_list[i - 1].name : string("(start)"), label_bytes[i]));
+    for(uint32_t i = 0; i < macro_bytes.size(); i++)
+        if(macro_bytes[i] > 0) _macros.push_back(make_pair(macro_list[i].name, macro_bytes[i]));
+    stable_sort(_files.begin(), _files.end(), size_entry_larger);
+    stable_sort(_spans.begin(), _spans.end(), size_entry_larger);
+    stable_sort(_macros.begin(), _macros.end(), size_entry_larger);
+    
+    char _buf[64];
+    vector<pair<string, uint32_t>> *_tables[3] = {&_files, &_spans, &_macros};
+    const char *_titles[3] = {"Files", "Label spans", "Macros"};
+    const char *_keys[3] = {"files", "spans", "macros"};
+    cout << "Size report: " << _total << " bytes" << endl;
+    for(uint32_t t = 0; t < 3; t++){
+        cout << _titles[t] << ":" << endl;
+        for(uint32_t i = 0; i < _tables[t]->size(); i++){
+            sprintf(_buf, "\t%6u  %5.1f%%  ", (*_tables[t])[i].second, _total ? (100.0 * (*_tables[t])[i].second / _total) : 0.0);
+            cout << _buf << (*_tables[t])[i].first;
+            if(t == 2) cout << " (" << macro_list[get_macro_id((*_tables[t])[i].first)].insert_count << " calls)";
+            cout << endl;
+        }
+    }
+    cout << "--------------------------------" << endl;
+    
+    ofstream _ofile;
+    if(_filename != "-"){
+        _ofile.open(_filename.c_str(), ios::out | ios::trunc);
+        if(!_ofile.is_open()) return error(ERROR_CREATE_FILE, _filename);
+    }
+    ostream &_out = (_filename != "-") ? _ofile : cout;
+    _out << "{\n  \"total\": " << _total;
+    for(uint32_t t = 0; t < 3; t++){
+        _out << ",\n  \"" << _keys[t] << "\": [";
+        for(uint32_t i = 0; i < _tables[t]->size(); i++){
+            _out << ((i > 0) ? "," : "") << "\n    {\"name\": " << json_string((*_tables[t])[i].first) << ", \"bytes\": " << (*_tables[t])[i].second;
+            if(t == 1){
+                int32_t _label_id = get_label_id((*_tables[t])[i].first);
+                if(_label_id >= 0) _out << ", \"address\": " << label_list[_label_id].address;
+            }
+            if(t == 2) _out << ", \"calls\": " << macro_list[get_macro_id((*_tables[t])[i].first)].insert_count;
+            _out << "}";
+        }
+        _out << ((_tables[t]->size() > 0) ? "\n  ]" : "]");
+    }
+    _out << "\n}" << endl;
+    if(_filename != "-") cout << "Size report saved to: " << _filename << endl;
+    return 0;
+}
+
+int asm8::write_object(string _out){
+    object.sections.back().data.assign(binary_out.begin() + object.sections.back().base, binary_out.end());
+    //Symbols are written in label_list order, so relocations can use label ids:
+    object.symbols.clear();
+    for(uint32_t i = 0; i < label_list.size(); i++){
+        uint8_t _kind = label_list[i].is_extern ? symbol_t::symbol_extern : (label_list[i].is_global ? symbol_t::symbol_global : symbol_t::symbol_local);
+        object.symbols.push_back(symbol_t(label_list[i].name, _kind, label_list[i].relocatable ? 0 : -1, label_list[i].address));
+    }
+    if(object.write(_out) != 0) return error(ERROR_CREATE_FILE, _out);
+    
+    cout << "\nFile successfully assembled\n" << "Object saved to: " << _out << endl;
+    return 0;
+}
+
+//Peephole rules, applied to every line until none of them matches anymore:
+class peephole_rule_t{
+    public:
+        const char  *name;
+        bool        (asm8::*apply)(uint32_t _line);
+};
+
+static const peephole_rule_t peephole_rules[] = {
+    {"jump to jump",            &asm8::peephole_thread_jump},
+    {"jump to next line",       &asm8::peephole_jump_to_next},
+    {"overwritten load",        &asm8::peephole_redundant_load},
+    {"lai 0 -> xra",            &asm8::peephole_zero_a},
+    {"cal + ret -> jmp",        &asm8::peephole_tail_call}
+};
+
+//Recompute all label addresses the same way pass 2 does:
+void asm8::relayout(){
+    uint32_t _address = 0;
+    uint32_t _label_pc = 0;
+    relocatable_pc = object_mode;
+    for(uint32_t i = 0; i < code.size(); i++){
+        if(code[i].size() < 1) continue;
+        if(is_directive(code[i], base_d)){
+            _label_pc = string_to_num(code[i][1]);
+            relocatable_pc = false;
+        }
+        else if(is_directive(code[i], org_d)){
+            _address = string_to_num(code[i][1]);
+            _label_pc = _address;
+            relocatable_pc = false;
+        }
+        else if(is_directive(code[i], rept_d)){
+            int32_t _end = find_endr(code, i);
+            uint32_t _rept_size = get_rept_size(vector<line_t>(code.begin() + i, code.begin() + _end + 1));
+            _address += _rept_size;
+            _label_pc += _rept_size;
+            i = _end;
+        }
+        else if(is_directive(code[i], db_d) || is_directive(code[i], dw_d) || is_directive(code[i], fill_d)){
+            uint32_t _data_size = get_data_size(code[i]);
+            _address += _data_size;
+            _label_pc += _data_size;
+        }
+        else if(is_directive(code[i], dsb_d)){
+            line_t _label;
+            _label.push_back(code[i][1] + string(":"));
+            set_label_addr(get_label_id(_label), _label_pc);
+            _label_pc += get_dsb_size(code[i]);
+        }
+        else if(is_label(code[i])){
+            set_label_addr(get_label_id(code[i]), _label_pc);
+        }
+        else if(check_instr_valid(code[i])){
+            _address += get_instr_size(code[i]);
+            _label_pc += get_instr_size(code[i]);
+        }
+    }
+}
+
+static bool chunk_larger(const code_chunk_t &_a, const code_chunk_t &_b){
+    return _a.size > _b.size;
+}
+
+static bool chunk_lower(const code_chunk_t &_a, const code_chunk_t &_b){
+    return (_a.base < _b.base) || ((_a.base == _b.base) && (_a.size < _b.size));
+}
+
+//The lines of every section are moved together behind its first .section
+//line, which becomes the .org that places it. Code outside sections and
+//fixed sections keep their address; the others go into the smallest gap
+//of their region that holds them, largest first, which leaves the least
+//padding between the blocks:
+void asm8::place_sections(){
+    vector<code_chunk_t> _chunks;
+    vector<int32_t> _section_chunk(section_list.size(), -1);
+    _chunks.push_back(code_chunk_t(-1, 0));
+    int32_t _outside = 0;
+    int32_t _chunk = 0;
+    for(uint32_t i = 0; i < code.size(); i++){
+        if(is_directive(code[i], section_d)){
+            vector<line_t> _operands = split_operands(code[i]);
+            int32_t _id = (_operands.size() > 0) ? get_section_id(_operands[0][0]) : -1;
+            if(_id < 0){
+                _chunk = _outside;
+                code[i].clear();
+            }
+            else{
+                if(_section_chunk[_id] < 0){
+                    _section_chunk[_id] = _chunks.size();
+                    _chunks.push_back(code_chunk_t(_id, 0));
+                }
+                else code[i].clear();
+                _chunk = _section_chunk[_id];
+            }
+        }
+        else if(is_directive(code[i], org_d) && (_chunks[_chunk].section < 0)){
+            _outside = _chunk = _chunks.size();
+            _chunks.push_back(code_chunk_t(-1, string_to_num(code[i][1])));
+        }
+        _chunks[_chunk].lines.push_back(i);
+    }
+    
+    //Fixed blocks first, their place is not up to the packing:
+    link8 _rom;
+    char _buf[128];
+    for(uint32_t i = 0; i < _chunks.size(); i++){
+        _chunks[i].size = get_lines_size(_chunks[i].lines);
+        if((_chunks[i].section >= 0) && !section_list[_chunks[i].section].fixed) continue;
+        if(_chunks[i].section >= 0) _chunks[i].base = section_list[_chunks[i].section].start;
+        if((_chunks[i].size > 0) && !_rom.place_at(_chunks[i].base, _chunks[i].size)){
+            encode_source = (_chunks[i].section >= 0) ? section_list[_chunks[i].section].first_defined : code_source[_chunks[i].lines[0]];
+            sprintf(_buf, "%s at 0x%04X (%u bytes) overlaps other code or leaves the memory", (_chunks[i].section >= 0) ? section_list[_chunks[i].section].name.c_str() : ".org", _chunks[i].base, _chunks[i].size);
+            error(ERROR_SECTION, _buf);
+        }
+    }
+    stable_sort(_chunks.begin(), _chunks.end(), chunk_larger);
+    for(uint32_t i = 0; i < _chunks.size(); i++){
+        if((_chunks[i].section < 0) || section_list[_chunks[i].section].fixed) continue;
+        code_section_t &_section = section_list[_chunks[i].section];
+        int32_t _base = (_chunks[i].size > 0) ? _rom.find_gap(_chunks[i].size, _section.start, _section.end) : _section.start;
+        if(_base < 0){
+            encode_source = _section.first_defined;
+            error(ERROR_SECTION, "no room for " + _section.name + " (" + to_string(_chunks[i].size) + " bytes)");
+        }
+        _rom.place_at(_base, _chunks[i].size);
+        _chunks[i].base = _base;
+    }
+    
+    stable_sort(_chunks.begin(), _chunks.end(), chunk_lower);
+    vector<uint32_t> _order;
+    for(uint32_t i = 0; i < _chunks.size(); i++){
+        if(_chunks[i].section >= 0){
+            section_list[_chunks[i].section].base = _chunks[i].base;
+            section_list[_chunks[i].section].size = _chunks[i].size;
+            code[_chunks[i].lines[0]] = line_t({directives[org_d], to_string(_chunks[i].base)});
+        }
+        _order.insert(_order.end(), _chunks[i].lines.begin(), _chunks[i].lines.end());
+    }
+    reorder_code(_order);
+    relayout();
+    encode_source = location_t();
+    
+    print_section_report(_chunks, _rom);
+}
+
+//Bytes the lines take in the image, like relayout() counts them:
+uint32_t asm8::get_lines_size(const vector<uint32_t> &_lines){
+    uint32_t _size = 0;
+    for(uint32_t i = 0; i < _lines.size(); i++){
+        const line_t &_code = code[_lines[i]];
+        if(_code.size() < 1) continue;
+        if(is_directive(_code, rept_d)){
+            int32_t _end = find_endr(code, _lines[i]);
+            if(_end < 0) continue;
+            _size += get_rept_size(vector<line_t>(code.begin() + _lines[i], code.begin() + _end + 1));
+            while((i + 1 < _lines.size()) && (_lines[i + 1] <= (uint32_t)_end)) i++;
+        }
+        else if(is_directive(_code, db_d) || is_directive(_code, dw_d) || is_directive(_code, fill_d)){
+            _size += get_data_size(_code);
+        }
+        else if(!is_label(_code) && check_instr_valid(_code)){
+            _size += get_instr_size(_code);
+        }
+    }
+    return _size;
+}
+
+//Puts the expanded lines into a new order, every line exactly once; the
+//expansion sites move with the lines they start at:
+void asm8::reorder_code(const vector<uint32_t> &_order){
+    vector<line_t> _code;
+    vector<location_t> _source;
+    vector<int32_t> _macro;
+    vector<uint32_t> _new_line(code.size(), 0);
+    for(uint32_t i = 0; i < _order.size(); i++){
+        _new_line[_order[i]] = i;
+        _code.push_back(move(code[_order[i]]));
+        _source.push_back(code_source[_order[i]]);
+        _macro.push_back(code_macro[_order[i]]);
+    }
+    for(uint32_t i = 0; i < expansion_site_lines.size(); i++)
+        if(expansion_site_lines[i] < code.size()) expansion_site_lines[i] = _new_line[expansion_site_lines[i]];
+    code = move(_code);
+    code_source = move(_source);
+    code_macro = move(_macro);
+}
+
+//Where every block went, the gaps left between them up to the end of the
+//image (filled with the fill byte), and how scattered the free memory is:
+void asm8::print_section_report(const vector<code_chunk_t> &_chunks, const link8 &_rom){
+    char _buf[128];
+    cout << "--------------------------------" << endl;
+    cout << "Sections:" << endl;
+    for(uint32_t i = 0; i < _chunks.size(); i++){
+        if(_chunks[i].section < 0){
+            if(_chunks[i].size < 1) continue;
+            sprintf(_buf, "\t0x%04X - 0x%04X\t%-20s", _chunks[i].base, _chunks[i].base + _chunks[i].size - 1, ".org");
+            cout << _buf << "\t(outside of sections)" << endl;
+            continue;
+        }
+        const code_section_t &_section = section_list[_chunks[i].section];
+        string _rule = "fixed";
+        if(!_section.fixed){
+            sprintf(_buf, "in 0x%04X - 0x%04X", _section.start, _section.end);
+            _rule = _buf;
+        }
+        if(_section.size > 0) sprintf(_buf, "\t0x%04X - 0x%04X\t%-20s", _section.base, _section.base + _section.size - 1, _rule.c_str());
+        else                  sprintf(_buf, "\t0x%04X (empty)\t%-20s", _section.base, _rule.c_str());
+        cout << _buf << "\t" << _section.name << endl;
+    }
+    
+    uint32_t _end = 0;
+    for(uint32_t i = 0; i < LINK8_MEMORY_SIZE; i++) if(_rom.used[i]) _end = i + 1;
+    uint32_t _padding = 0;
+    uint32_t _gaps = 0;
+    uint32_t _largest = LINK8_MEMORY_SIZE - _end;
+    for(uint32_t i = 0; i < _end; i++){
+        if(_rom.used[i]) continue;
+        uint32_t _gap = i;
+        while(!_rom.used[i]) i++;
+        sprintf(_buf, "\tgap 0x%04X - 0x%04X\t%u bytes", _gap, i - 1, i - _gap);
+        cout << _buf << endl;
+        _padding += i - _gap;
+        _gaps++;
+        if(i - _gap > _largest) _largest = i - _gap;
+    }
+    uint32_t _free = _padding + LINK8_MEMORY_SIZE - _end;
+    sprintf(_buf, "Padding: %u bytes in %u gap(s), %u bytes free behind the image, fragmentation %.1f%%",
+            _padding, _gaps, LINK8_MEMORY_SIZE - _end, (_free > 0) ? (100.0 * (_free - _largest) / _free) : 0.0);
+    cout << _buf << endl;
+    cout << "--------------------------------" << endl;
+}
+
+void asm8::optimize(){
+    peephole_hits.assign(num_elements(peephole_rules), 0);
+    bool _changed = true;
+    while(_changed){
+        _changed = false;
+        peephole_label_line.clear();
+        for(uint32_t i = 0; i < code.size(); i++)
+            if(is_label(code[i])) peephole_label_line[code[i][0].substr(0, code[i][0].find(":"))] = i;
+        
+        for(uint32_t i = 0; i < code.size(); i++){
+            if((code[i].size() < 1) || is_directive(code[i], any_d) || is_label(code[i])) continue;
+            for(uint32_t r = 0; r < num_elements(peephole_rules); r++){
+                uint32_t _bytes = peephole_bytes_saved;
+                location_t _location = code_source[i];
+                peephole_site_cycles = 0;
+                if((this->*peephole_rules[r].apply)(i)){
+                    peephole_hits[r]++;
+                    peephole_sites.push_back(peephole_site_t(_location, r, peephole_bytes_saved - _bytes, peephole_site_cycles));
+                    _changed = true;
+                    if(code[i].size() < 1) break;
+                }
+            }
+        }
+        //Removed bytes move everything behind them, so labels are laid out again:
+        if(_changed) relayout();
+    }
+    
+    cout << "Peephole:" << endl;
+    for(uint32_t r = 0; r < num_elements(peephole_rules); r++)
+        if(peephole_hits[r] > 0) cout << "\t" << peephole_rules[r].name << ":\t" << peephole_hits[r] << endl;
+    cout << "\tsaved " << peephole_bytes_saved << " bytes" << endl;
+    //Cycles are only saved when a line runs, so they are not added up:
+    if(peephole_sites.size() > 0) cout << "\tT-states saved per run, by line:" << endl;
+    for(uint32_t i = 0; i < peephole_sites.size(); i++){
+        if(peephole_sites[i].cycles < 1) continue;
+        cout << "\t\t" << format_location(peephole_sites[i].location) << "\t" << peephole_rules[peephole_sites[i].rule].name << "\t" << peephole_sites[i].cycles << endl;
+    }
+    cout << "--------------------------------" << endl;
+}
+
+//Next line with code after _line, labels and directives included:
+int32_t asm8::next_code_line(uint32_t _line){
+    for(uint32_t i = _line + 1; i < code.size(); i++) if(code[i].size() > 0) return i;
+    return -1;
+}
+
+//True if the flags set at _line are overwritten before anything can read them:
+bool asm8::flags_dead_after(uint32_t _line){
+    string _live = "czsp";
+    for(int32_t i = next_code_line(_line); i >= 0; i = next_code_line(i)){
+        if(is_label(code[i]) || is_directive(code[i], any_d)) return false;
+        switch(get_instr_type(code[i])){
+            case adc_instr:
+            case sbc_instr:
+                if(_live.find('c') != string::npos) return false;
+                return true;
+            case add_instr:
+            case sub_instr:
+            case and_instr:
+            case xor_instr:
+            case or_instr:
+            case cp_instr:
+            case halt_instr:
+                return true;
+            case ral_instr:
+            case rar_instr:
+                if(_live.find('c') != string::npos) return false;
+                break;
+            case rlc_instr:
+            case rrc_instr:
+                if(_live.find('c') != string::npos) _live.erase(_live.find('c'), 1);
+                break;
+            case inc_instr:
+            case dec_instr:
+                _live = (_live.find('c') != string::npos) ? "c" : "";
+                break;
+            case ret_instr:
+            case jmp_instr:
+            case cal_instr:
+            case rst_instr:
+                return false;
+            default:
+                break;
+        }
+        if(_live.length() < 1) return true;
+    }
+    return false;
+}
+
+void asm8::peephole_remove(uint32_t _line){
+    peephole_bytes_saved += get_instr_size(code[_line]);
+    peephole_site_cycles += get_instr_cycles(code[_line]);
+    code[_line].clear();
+}
+
+//jmp/cal to a label whose first instruction is "jmp x" goes to x directly:
+bool asm8::peephole_thread_jump(uint32_t _line){
+    instr_type _type = get_instr_type(code[_line]);
+    if(((_type != jmp_instr) && (_type != cal_instr)) || (code[_line].size() != 2)) return false;
+    
+    string _target = code[_line][1];
+    line_t _visited;
+    while(true){
+        if(peephole_label_line.find(_target) == peephole_label_line.end()) break;
+        int32_t i = peephole_label_line[_target];
+        while((i >= 0) && ((code[i].size() < 1) || is_label(code[i]))) i = next_code_line(i);
+        if((i < 0) || (code[i][0] != "jmp") || (code[i].size() != 2)) break;
+        if(find(_visited.begin(), _visited.end(), code[i][1]) != _visited.end()) return false;
+        _visited.push_back(code[i][1]);
+        _target = code[i][1];
+    }
+    if(_target == code[_line][1]) return false;
+    
+    //Every jump of the chain is skipped when this line runs:
+    code[_line][1] = _target;
+    peephole_site_cycles += 11 * _visited.size();
+    return true;
+}
+
+//A jump to the label right behind it does nothing:
+bool asm8::peephole_jump_to_next(uint32_t _line){
+    if((get_instr_type(code[_line]) != jmp_instr) || (code[_line].size() != 2)) return false;
+    for(int32_t i = next_code_line(_line); (i >= 0) && is_label(code[i]); i = next_code_line(i)){
+        if(code[i][0].substr(0, code[i][0].find(":")) == code[_line][1]){
+            peephole_remove(_line);
+            return true;
+        }
+    }
+    return false;
+}
+
+//A load whose register is loaded again by the next instruction is dead,
+//unless the second load reads the register or M through H and L:
+bool asm8::peephole_redundant_load(uint32_t _line){
+    if(get_instr_type(code[_line]) != ld_instr) return false;
+    int32_t _next = next_code_line(_line);
+    if((_next < 0) || (get_instr_type(code[_next]) != ld_instr)) return false;
+    
+    char _dst = code[_line][0][1];
+    if(code[_next][0][1] != _dst) return false;
+    if(code[_next][0][2] == _dst) return false;
+    if((code[_next][0][2] == 'm') && ((_dst == 'h') || (_dst == 'l'))) return false;
+    
+    peephole_remove(_line);
+    return true;
+}
+
+//"lai 0" takes two bytes and 8 T-states, "xra" one byte and 5, but it changes the flags:
+bool asm8::peephole_zero_a(uint32_t _line){
+    //Only a number literal, as written or left by a define; a label is not known to be 0:
+    int32_t _value;
+    if((code[_line].size() != 2) || (code[_line][0] != "lai") || !parse_num(code[_line][1], _value) || (_value != 0)) return false;
+    if(!flags_dead_after(_line)) return false;
+    
+    code[_line].clear();
+    code[_line].push_back("xra");
+    peephole_bytes_saved += 1;
+    peephole_site_cycles += 3;
+    return true;
+}
+
+//"cal x" directly followed by "ret" can jump to x and let it return for us:
+bool asm8::peephole_tail_call(uint32_t _line){
+    if((code[_line].size() != 2) || (code[_line][0] != "cal")) return false;
+    int32_t _next = next_code_line(_line);
+    if((_next < 0) || (code[_next][0] != "ret")) return false;
+    
+    code[_line][0] = "jmp";
+    peephole_remove(_next);
+    return true;
+}
+
+void asm8::print_timing_report(){
+    char _buf[64];
+    cout << "--------------------------------" << endl;
+    cout << "Timing (T-states min/max):" << endl;
+    for(uint32_t i = 0; i < routine_timing_list.size(); i++){
+        sprintf(_buf, "\t0x%04X  %6u / %-6u\t", routine_timing_list[i].address, routine_timing_list[i].cycles_min, routine_timing_list[i].cycles_max);
+        cout << _buf << routine_timing_list[i].name << endl;
+    }
+    if(span_timing_list.size() > 0){
+        cout << "Spans (T-states min/max):" << endl;
+        for(uint32_t i = 0; i < span_timing_list.size(); i++){
+            sprintf(_buf, "\t0x%04X  %6u / %-6u\t", span_timing_list[i].address, span_timing_list[i].cycles_min, span_timing_list[i].cycles_max);
+            cout << _buf << span_timing_list[i].name << endl;
+        }
+    }
+    cout << "--------------------------------" << endl;
+}
+
+class line_profile_t{
+    public:
+        uint16_t    file_id;
+        uint32_t    line;
+        uint64_t    count;
+        uint64_t    cycles;
+        bool        has_code;
+        
+        line_profile_t(){file_id = 0; line = 0; count = 0; cycles = 0; has_code = false;}
+};
+
+static bool line_profile_hotter(const line_profile_t &_a, const line_profile_t &_b){
+    return _a.cycles > _b.cycles;
+}
+
+static line_t read_source_lines(string _filename){
+    line_t _lines;
+    string _line;
+    ifstream _file(_filename.c_str());
+    while(getline(_file, _line)){
+        if((_line.length() > 0) && (_line[_line.length() - 1] == '\r')) _line.erase(_line.length() - 1);
+        _lines.push_back(_line);
+    }
+    return _lines;
+}
+
+int asm8::write_profile(string _filename, const vector<uint64_t> &_count, const vector<uint64_t> &_cycles){
+    ofstream _ofile;
+    if(_filename != "-"){
+        _ofile.open(_filename.c_str(), ios::out | ios::trunc);
+        if(!_ofile.is_open()) return error(ERROR_CREATE_FILE, _filename);
+    }
+    ostream &_out = (_filename != "-") ? _ofile : cout;
+    
+    //Map every executed address back to the source line it was assembled from:
+    vector<uint16_t> _files;
+    map<uint16_t, vector<line_profile_t>> _lines;
+    vector<pair<string, uint64_t>> _routines;
+    uint64_t _total_cycles = 0;
+    uint32_t _instr_total = 0;
+    uint32_t _instr_hit = 0;
+    for(uint32_t i = 0; i < code.size(); i++){
+        if(is_label(code[i])){
+            _routines.push_back(make_pair(code[i][0].substr(0, code[i][0].find(":")), (uint64_t)0));
+            continue;
+        }
+        if(is_directive(code[i], any_d) || (get_instr_size(code[i]) == 0)) continue;
+        uint32_t _addr = code_address[i];
+        if(_addr >= _count.size()) continue;
+        
+        if(_lines.find(code_source[i].file_id) == _lines.end()) _files.push_back(code_source[i].file_id);
+        vector<line_profile_t> &_file_lines = _lines[code_source[i].file_id];
+        if(_file_lines.size() <= code_source[i].line) _file_lines.resize(code_source[i].line + 1);
+        line_profile_t &_lp = _file_lines[code_source[i].line];
+        _lp.file_id = code_source[i].file_id;
+        _lp.line = code_source[i].line;
+        _lp.has_code = true;
+        _lp.count = max(_lp.count, _count[_addr]);
+        _lp.cycles += _cycles[_addr];
+        
+        _instr_total++;
+        if(_count[_addr] > 0) _instr_hit++;
+        if(_routines.size() > 0) _routines.back().second += _cycles[_addr];
+        _total_cycles += _cycles[_addr];
+    }
+    
+    char _buf[128];
+    _out << "Profile: " << _total_cycles << " T-states" << endl;
+    sprintf(_buf, "Coverage: %u of %u instructions executed (%.1f%%)", _instr_hit, _instr_total, _instr_total ? (100.0 * _instr_hit / _instr_total) : 0.0);
+    _out << _buf << endl << endl;
+    
+    //Hot spots, by source line:
+    vector<line_profile_t> _hot;
+    map<uint16_t, line_t> _sources;
+    for(uint32_t i = 0; i < _files.size(); i++){
+        _sources[_files[i]] = read_source_lines(file_table[_files[i]]);
+        for(uint32_t j = 0; j < _lines[_files[i]].size(); j++)
+            if(_lines[_files[i]][j].cycles > 0) _hot.push_back(_lines[_files[i]][j]);
+    }
+    stable_sort(_hot.begin(), _hot.end(), line_profile_hotter);
+    _out << "Hot spots:" << endl;
+    _out << "      T-states       %       count  location" << endl;
+    for(uint32_t i = 0; (i < _hot.size()) && (i < 20); i++){
+        sprintf(_buf, "  %12llu  %5.1f%%  %10llu  ", (unsigned long long)_hot[i].cycles, _total_cycles ? (100.0 * _hot[i].cycles / _total_cycles) : 0.0, (unsigned long long)_hot[i].count);
+        const line_t &_src = _sources[_hot[i].file_id];
+        _out << _buf << file_table[_hot[i].file_id] << ":" << _hot[i].line << "\t" << ((_hot[i].line - 1 < _src.size()) ? _src[_hot[i].line - 1] : "") << endl;
+    }
+    _out << endl;
+    
+    _out << "Routines:" << endl;
+    for(uint32_t i = 0; i < _routines.size(); i++){
+        if(_routines[i].second == 0) continue;
+        sprintf(_buf, "  %12llu  %5.1f%%  ", (unsigned long long)_routines[i].second, _total_cycles ? (100.0 * _routines[i].second / _total_cycles) : 0.0);
+        _out << _buf << _routines[i].first << endl;
+    }
+    _out << endl;
+    
+    //Annotated listing, "#####" marks lines with code that never ran:
+    for(uint32_t i = 0; i < _files.size(); i++){
+        const line_t &_src = _sources[_files[i]];
+        const vector<line_profile_t> &_file_lines = _lines[_files[i]];
+        _out << "-------- " << file_table[_files[i]] << endl;
+        for(uint32_t j = 0; j < _src.size(); j++){
+            if((j + 1 < _file_lines.size()) && _file_lines[j + 1].has_code){
+                if(_file_lines[j + 1].count > 0)    sprintf(_buf, "%10llu %12llu %5u: ", (unsigned long long)_file_lines[j + 1].count, (unsigned long long)_file_lines[j + 1].cycles, j + 1);
+                else                                sprintf(_buf, "%10s %12s %5u: ", "#####", "", j + 1);
+            }
+            else{
+                sprintf(_buf, "%10s %12s %5u: ", "-", "", j + 1);
+            }
+            _out << _buf << _src[j] << endl;
+        }
+    }
+    return 0;
+}
+
 int asm8::error(int _error_code, string _str){
     string _error;
     switch(_error_code){
         case ERROR_INVALID_EXPRESSION:
-            _error = "Invalid Expression"; break;
+            _error = "Invalid Expression" + ((_str.length() > 0) ? ": " + _str : string("")); break;
         case ERROR_OPEN_FILE:
             _error = "Could not open file: " + _str; break;
         case ERROR_CREATE_FILE:
@@ -1250,17 +2874,33 @@ int asm8::error(int _error_code, string _str){
             _error = "Fitting .endm directive not found for Macro: " + _str; break;
         case ERROR_MISSING_MACRO_ARGS:
             _error = "Missing Macro Arguments"; break;
-        case ERROR_MAX_TRIES_PASS_2:
-            _error = "Required too many tries on Pass 2"; break;
+        case ERROR_CIRCULAR_REFERENCE:
+            _error = "Circular reference: " + _str; break;
         case ERROR_INVALID_INSTR:
             _error = "Invalid Instruction"; break;
         case ERROR_ORG_BACK:
             _error = ".org smaller than current PC"; break;
+        case ERROR_TIMING_SPAN:
+            _error = "Invalid timing span: " + _str; break;
+        case ERROR_RELOCATION:
+            _error = "Relocation: " + _str; break;
+        case ERROR_RANGE:
+            _error = "Value out of range for " + _str; break;
+        case ERROR_REPT:
+            _error = "Invalid .rept block: " + _str; break;
+        case ERROR_SECTION:
+            _error = "Section: " + _str; break;
     }
-    cerr << ((asm8::asm8_p->current_file != nullptr) ? string(asm8::asm8_p->current_file->filename + ", ") : string("")) <<
-            ((asm8::asm8_p->current_file != nullptr) ? string("Line ") + to_string(asm8::asm8_p->current_file->current_line) + string(":\n") : string("")) <<
-            "Error: " << _error << endl;
-    exit(-1);
+    
+    asm8 *_asm8 = asm8::asm8_p;
+    location_t _location = _asm8->source_location();
+    //Pass 2 reads the files again, so errors pass 1 found already are not repeated:
+    bool _known = false;
+    for(uint32_t i = 0; (i < _asm8->diagnostics.size()) && !_known; i++)
+        _known = (_asm8->diagnostics[i].message == _error) && (_asm8->diagnostics[i].location.file_id == _location.file_id) && (_asm8->diagnostics[i].location.line == _location.line);
+    if(!_known) _asm8->diagnostics.push_back(diagnostic_t(_error_code, _error, _location));
+    if((_asm8->max_errors > 0) && (_asm8->diagnostics.size() >= _asm8->max_errors)) throw error_limit_t();
+    throw assembly_error_t();
 }
 
 
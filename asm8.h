@@ -13,6 +13,13 @@ using namespace std;
 #include <fstream>
 #include <vector>
 #include <string>
+#include <map>
+#include <unordered_map>
+#include "link8.h"
+#include "read8.h"
+#include "out8.h"
+#include "map8.h"
+#include "xref8.h"
 
 #define num_elements(a)     ((uint32_t)(sizeof(a) / sizeof(a[0])))
 
@@ -25,52 +32,177 @@ using namespace std;
 #define ERROR_LABEL_ALREADY_EXISTS          -6
 #define ERROR_ENDM_NOT_FOUND                -7
 #define ERROR_MISSING_MACRO_ARGS            -8
-#define ERROR_MAX_TRIES_PASS_2              -9
+#define ERROR_CIRCULAR_REFERENCE            -9
 #define ERROR_INVALID_INSTR                 -10
 #define ERROR_ORG_BACK                      -11
+#define ERROR_TIMING_SPAN                   -12
+#define ERROR_RELOCATION                    -13
+#define ERROR_RANGE                         -14
+#define ERROR_REPT                          -15
+#define ERROR_SECTION                       -16
 
 #define MAX_FILE_STACK_SIZE         100
-#define MAX_TRIES_PASS_2            100
+#define MAX_MACRO_CACHE_SIZE        64
+
+//Where something was written in the source; file_id indexes asm8::file_table:
+class location_t{
+    public:
+        uint16_t    file_id;
+        uint32_t    line;
+        
+        location_t(uint16_t _file_id = 0, uint32_t _line = 0);
+};
 
 class file_t{
     public:
+        uint16_t    file_id;
         string      filename;
-        string      content;
+        shared_ptr<const lexed_file_t>  source;
         uint32_t    total_lines;
         uint32_t    current_line;
+        //When the file was opened, for its span in a --trace:
+        uint64_t    trace_start;
         
-        file_t(string _filename);
-        void filename_convert_slash();
-        void content_convert_newline();
+        file_t(shared_ptr<const lexed_file_t> _source);
 };
 
+//The value is evaluated on first use and cached; one that depends on labels
+//is evaluated again once a label moved since (generation):
 class define_t{
     public:
         string      name;
         int         value;
-        string      details_first_defined;
+        line_t      expression;
+        location_t  first_defined;
+        bool        uses_labels;
+        bool        evaluated;
+        bool        evaluating;
+        uint32_t    generation;
+        
+        define_t(string _name, int _value, location_t _first_defined = location_t());
+};
+
+//A local label token inside a cached expansion; every call inserts its own
+//"_<insert_count>" between prefix and postfix:
+class macro_rename_t{
+    public:
+        uint32_t    line;
+        uint32_t    word;
+        string      prefix;
+        string      postfix;
         
-        define_t(string _name, int _value, string _details = "");
+        macro_rename_t(uint32_t _line, uint32_t _word, string _prefix, string _postfix);
+};
+
+//Macro body with the arguments already substituted:
+class macro_expansion_t{
+    public:
+        vector<line_t>          code;
+        vector<macro_rename_t>  renames;
 };
 
 class macro_t{
     public:
         string  name;
-        vector<string>          arg_list;
-        vector<vector<string>>  code;
+        vector<string>  arg_list;
+        vector<line_t>  code;
         uint32_t insert_count;
-        string  details_first_defined;
+        location_t  first_defined;
+        unordered_map<string, macro_expansion_t>    expansion_cache;
         
-        macro_t(string _name, vector<string> _arg_list, vector<vector<string>> _code, string _details = "");
+        macro_t(string _name, vector<string> _arg_list, vector<line_t> _code, location_t _first_defined = location_t());
 };
 
 class label_t{
     public:
         string      name;
         uint32_t    address;
-        string details_first_defined;
+        location_t  first_defined;
+        bool        relocatable;
+        bool        is_global;
+        bool        is_extern;
+        bool        placed;
+        
+        label_t(string _name, location_t _first_defined = location_t());
+};
+
+//A streamed line with more than one label that was not placed yet; it is
+//encoded again at the end:
+class fixup_line_t{
+    public:
+        uint32_t        address;
+        location_t      location;
+        line_t          code;
+        
+        fixup_line_t(uint32_t _address, location_t _location, line_t _code);
+};
+
+//One recorded error; error() stores it and throws assembly_error_t, so the
+//pass skips the line and goes on:
+class diagnostic_t{
+    public:
+        int             code;
+        string          message;
+        location_t      location;
+        
+        diagnostic_t(int _code, string _message, location_t _location);
+};
+
+class assembly_error_t{};
+
+//Thrown instead once max_errors diagnostics were recorded:
+class error_limit_t{};
+
+//One rewrite of the peephole optimizer: the bytes it removed and the
+//T-states it saves every time that line runs:
+class peephole_site_t{
+    public:
+        location_t  location;
+        uint32_t    rule;
+        uint32_t    bytes;
+        uint32_t    cycles;
         
-        label_t(string _name, string _details = "");
+        peephole_site_t(location_t _location, uint32_t _rule, uint32_t _bytes, uint32_t _cycles);
+};
+
+class timing_t{
+    public:
+        string      name;
+        uint32_t    address;
+        uint32_t    cycles_min;
+        uint32_t    cycles_max;
+        
+        timing_t(string _name, uint32_t _address);
+};
+
+//A named section: all lines after ".section name" up to the next .section
+//are placed together, at a fixed address or into a gap of the region
+//start..end; address and label_pc are its cursors in pass 2:
+class code_section_t{
+    public:
+        string      name;
+        bool        fixed;
+        bool        has_rule;
+        uint32_t    start;
+        uint32_t    end;
+        uint32_t    base;
+        uint32_t    size;
+        uint32_t    address;
+        uint32_t    label_pc;
+        location_t  first_defined;
+        
+        code_section_t(string _name, location_t _first_defined = location_t());
+};
+
+//Lines placed as one block: a section, or code outside sections up to its next .org:
+class code_chunk_t{
+    public:
+        int32_t             section;
+        uint32_t            base;
+        uint32_t            size;
+        vector<uint32_t>    lines;
+        
+        code_chunk_t(int32_t _section, uint32_t _base);
 };
 
 class asm8{
@@ -86,50 +218,135 @@ class asm8{
         };
         
         static asm8         *asm8_p;
+        read8               reader;
         vector<file_t>      file_stack;
         file_t              *current_file;
-        vector<vector<string>>  code;
+        vector<string>      file_table;
+        map<string, uint16_t>   file_ids;
+        vector<line_t>          code;
+        vector<location_t>      code_source;
+        vector<uint32_t>        code_address;
         uint32_t            code_line;
         vector<define_t>    define_list;
         vector<macro_t>     macro_list;
         vector<label_t>     label_list;
+        //Counts label moves, cached define values older than that are stale:
+        uint32_t            label_generation;
+        unordered_map<string, uint32_t> define_ids;
+        unordered_map<string, uint32_t> macro_ids;
+        unordered_map<string, uint32_t> label_ids;
+        vector<timing_t>    routine_timing_list;
+        vector<timing_t>    span_timing_list;
         
         vector<uint8_t>      binary_out;
+        vector<segment_t>    segments;
+        uint8_t              org_fill;
+        out8::format_t       format;
         uint32_t             address;
+        vector<uint32_t>     open_spans;
+        
+        //Symbol map: source of the line being encoded, the line table and
+        //where macros were expanded (code line until pass 3 placed it):
+        string              map_file;
+        string              map_binary_file;
+        location_t          encode_source;
+        vector<map_line_t>  line_map;
+        vector<map_line_t>  expansion_sites;
+        vector<uint32_t>    expansion_site_lines;
+        
+        //Cross-reference index: every use of a label, define or macro:
+        string              xref_file;
+        vector<xref_use_t>  xref_uses;
+        
+        //Size report: bytes per file, per label span (label id + 1, the first
+        //entry is the span before any label) and per macro body:
+        string              size_report_file;
+        int32_t             encode_macro;
+        vector<int32_t>     code_macro;
+        vector<uint32_t>    file_bytes;
+        vector<uint32_t>    label_bytes;
+        vector<uint32_t>    macro_bytes;
+        int32_t             span_label;
+        
+        //Streaming: lines are encoded right after pass 2 expanded them, forward
+        //label references are patched from fixups at the end:
+        bool                streaming;
+        vector<reloc_t>     fixups;
+        vector<fixup_line_t>    fixup_lines;
+        
+        //Relocatable object output; addresses before the first .org/.base are
+        //relative to the module's text section:
+        bool                object_mode;
+        bool                relocatable_pc;
+        vector<string>      global_list;
+        object_t            object;
+        
+        //Sections; the cursor of the code outside them is kept while one is open:
+        vector<code_section_t>  section_list;
+        int32_t             current_section;
+        uint32_t            outside_address;
+        uint32_t            outside_label_pc;
+        
+        vector<diagnostic_t>    diagnostics;
+        uint32_t            max_errors;
+        
+        bool                peephole;
+        uint32_t            peephole_bytes_saved;
+        //T-states the rule being applied saves per run of its line:
+        uint32_t            peephole_site_cycles;
+        vector<peephole_site_t> peephole_sites;
+        vector<uint32_t>    peephole_hits;
+        map<string, uint32_t>   peephole_label_line;
         
         asm8();
         int assemble(string _in, string _out);
+        int assemble_passes(string _in, string _out);
         void open_file(string _filename);
         void close_current_file();
+        uint16_t get_file_id(string _filename);
+        location_t current_location();
+        location_t source_location();
+        void add_xref(uint8_t _kind, uint32_t _id, location_t _location);
+        string format_location(location_t _location);
         
-        const string special_char = ",()<>+-*/";
-        vector<string> split_current_line_into_words();
+        line_t split_current_line_into_words();
         
-        string add_label(vector<string> _code);
+        string add_label(line_t _code);
         
-        bool is_directive(vector<string> _code, uint32_t _directive);
-        bool is_label(vector<string> _code);
-        bool is_define(vector<string> _code);
-        bool is_macro(vector<string> _code);
+        bool is_directive(line_t _code, uint32_t _directive);
+        bool is_label(line_t _code);
+        bool is_define(line_t _code);
+        bool is_macro(line_t _code);
         
-        bool contains_define(vector<string> _code);
-        bool contains_macro(vector<string> _code);
-        bool contains_label(vector<string> _code);
-        bool contains_expression(vector<string> _code);
+        bool contains_define(line_t _code);
+        bool contains_macro(line_t _code);
+        bool contains_label(line_t _code);
+        bool contains_expression(line_t _code);
         
-        vector<string> insert_define(vector<string> _code);
-        vector<vector<string>> insert_macro(vector<string> _code);
-        vector<string> insert_label(vector<string> _code);
-        vector<string>evaluate_expression(vector<string> _code);
+        line_t insert_define(line_t _code, bool _labels = true);
+        vector<line_t> insert_macro(line_t _code);
+        macro_expansion_t expand_macro(uint32_t _macro_id, const line_t &_arg_list);
+        line_t insert_label(line_t _code);
+        line_t evaluate_expression(line_t _code);
+        void resolve_defines();
+        void resolve_define(uint32_t _define_id, vector<uint8_t> &_state, vector<uint32_t> &_chain);
+        int32_t define_value(uint32_t _define_id);
+        bool define_ready(uint32_t _define_id);
+        void check_macro_recursion(const vector<uint32_t> &_expansion_macro, const vector<int32_t> &_expansion_parent, int32_t _expansion, uint32_t _macro_id);
         
-        int32_t string_to_num(string _str);
+        bool parse_num(const string &_str, int32_t &_value);
+        int32_t string_to_num(string _str, uint32_t _bits = 0);
         
         enum directives_t {include_d = 0,   define_d = 1,   macro_d = 2,    endm_d = 3,
                            if_d = 4,        endif_d = 5,    org_d = 6,      base_d = 7,
                            db_d = 8,        dsb_d = 9,      incbin_d = 10,
-                           any_d = 15
+                           timing_d = 11,   endtiming_d = 12,
+                           global_d = 13,   extern_d = 14,
+                           rept_d = 15,     endr_d = 16,    fill_d = 17,    dw_d = 18,
+                           section_d = 19,
+                           any_d = 20
                           };
-        const string directives[11] = {
+        const string directives[20] = {
             ".include",
             ".define",
             ".macro",
@@ -140,34 +357,90 @@ class asm8{
             ".base",
             ".db",
             ".dsb",
-            ".incbin"
+            ".incbin",
+            ".timing",
+            ".endtiming",
+            ".global",
+            ".extern",
+            ".rept",
+            ".endr",
+            ".fill",
+            ".dw",
+            ".section"
         };
-        void do_directive(vector<string> _code);
-        string directive_include(vector<string> _code);
-        string directive_define(vector<string> _code);
-        string directive_macro(vector<string> _code);
-        string directive_endm(vector<string> _code);
-        string directive_if(vector<string> _code);
-        string directive_endif(vector<string> _code);
-        string directive_org(vector<string> _code);
-        string directive_base(vector<string> _code);
-        string directive_dsb(vector<string> _code, uint32_t _addr);
-        string directive_incbin(vector<string> _code);
-        void skip_directive_macro(vector<string> _code);
-        void skip_directive_if(vector<string> _code);
-        
-        uint32_t get_db_size(vector<string> _code);
-        uint32_t get_dsb_size(vector<string> _code);
-        
-        int32_t get_label_id(vector<string> _code);
+        void do_directive(line_t _code);
+        string directive_include(line_t _code);
+        string directive_define(line_t _code);
+        string directive_macro(line_t _code);
+        string directive_endm(line_t _code);
+        string directive_if(line_t _code);
+        string directive_endif(line_t _code);
+        string directive_org(line_t _code);
+        string directive_base(line_t _code);
+        string directive_dsb(line_t _code, uint32_t _addr);
+        string directive_incbin(line_t _code);
+        string directive_global(line_t _code);
+        string directive_extern(line_t _code);
+        string directive_section(line_t _code, uint32_t &_address, uint32_t &_label_pc);
+        void skip_directive_macro(line_t _code);
+        void skip_directive_if(line_t _code);
+        
+        uint32_t get_db_size(line_t _code);
+        uint32_t get_dsb_size(line_t _code);
+        uint32_t get_data_size(line_t _code);
+        vector<line_t> split_operands(const line_t &_code);
+        int32_t evaluate_operand(line_t _operand, uint32_t _bits = 0);
+        
+        int32_t find_endr(const vector<line_t> &_lines, uint32_t _rept);
+        void get_rept_args(const line_t &_code, uint32_t &_count, string &_var);
+        vector<line_t> get_rept_iteration(const vector<line_t> &_block, uint32_t _index);
+        uint32_t get_rept_size(const vector<line_t> &_block);
+        
+        int32_t get_label_id(line_t _code);
+        int32_t get_label_id(const string &_name);
+        int32_t get_define_id(const string &_name);
+        int32_t get_macro_id(const string &_name);
+        int32_t get_section_id(const string &_name);
         void set_label_addr(uint32_t _label_id, uint32_t _addr);
-        int get_define_value(vector<string> _code);
-        string get_macro(vector<string> _code);
+        int get_define_value(line_t _code);
+        string get_macro(line_t _code);
+        
+        instr_type get_instr_type(line_t _code);
+        bool check_instr_valid(line_t _code);
+        uint8_t get_instr_size(line_t _code);
+        uint8_t get_instr_cycles(line_t _code, bool _taken = true);
+        vector<uint8_t> translate_instr(line_t _code);
+        void emit_byte(uint8_t _byte, bool _populated = true);
+        void encode_line(line_t &_code, bool _list = true);
+        uint32_t encode_at(vector<line_t> &_lines, uint32_t _line);
+        void encode_rept(const vector<line_t> &_block, bool _list);
+        int32_t get_fixup_label(line_t _code);
+        void resolve_fixups();
+        
+        void relayout();
+        void place_sections();
+        uint32_t get_lines_size(const vector<uint32_t> &_lines);
+        void reorder_code(const vector<uint32_t> &_order);
+        void print_section_report(const vector<code_chunk_t> &_chunks, const link8 &_rom);
+        void optimize();
+        int32_t next_code_line(uint32_t _line);
+        bool flags_dead_after(uint32_t _line);
+        void peephole_remove(uint32_t _line);
+        bool peephole_thread_jump(uint32_t _line);
+        bool peephole_jump_to_next(uint32_t _line);
+        bool peephole_redundant_load(uint32_t _line);
+        bool peephole_zero_a(uint32_t _line);
+        bool peephole_tail_call(uint32_t _line);
+        
+        int32_t get_reloc_label(line_t _code);
+        reloc_t make_reloc(line_t _code, int32_t _label_id, uint32_t _addr);
+        int write_object(string _out);
+        int write_map();
+        int write_xref();
+        int write_size_report(string _filename);
         
-        instr_type get_instr_type(vector<string> _code);
-        bool check_instr_valid(vector<string> _code);
-        uint8_t get_instr_size(vector<string> _code);
-        vector<uint8_t> translate_instr(vector<string> _code);
+        void print_timing_report();
+        int write_profile(string _filename, const vector<uint64_t> &_count, const vector<uint64_t> &_cycles);
         
         static int error(int _error, string _str = "");
 };
@@ -1,12 +1,35 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += main.cpp \
-    asm8.cpp
+    asm8.cpp \
+    cache8.cpp \
+    dis8.cpp \
+    emu8.cpp \
+    lex8.cpp \
+    link8.cpp \
+    map8.cpp \
+    out8.cpp \
+    read8.cpp \
+    trace8.cpp \
+    watch8.cpp \
+    xref8.cpp
 
 HEADERS += \
     asm8.h \
+    cache8.h \
+    dis8.h \
+    emu8.h \
+    lex8.h \
+    link8.h \
+    map8.h \
+    out8.h \
+    read8.h \
+    trace8.h \
+    vec8.h \
+    watch8.h \
+    xref8.h \
     instructions.h \
     main.h
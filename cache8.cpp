@@ -0,0 +1,82 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Build Cache
+ * Content addressed cache of assembled outputs, keyed by all inputs and options
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+#include "cache8.h"
+#include "out8.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+cache8::cache8(string _dir, string _options){
+    dir = _dir;
+    while((dir.length() > 1) && (dir[dir.length() - 1] == '/')) dir.erase(dir.length() - 1);
+    options = "asm8 cache " + to_string(CACHE8_VERSION) + "\n" + _options;
+}
+
+//Copies the cached output when every file the last build read is unchanged;
+//returns -1 on a miss, otherwise what out8::write_file returned:
+int cache8::fetch(string _in, string _out){
+    ifstream _manifest(manifest_path(_in).c_str());
+    if(!_manifest.is_open()) return -1;
+    
+    string _key, _line;
+    if(!getline(_manifest, _key)) return -1;
+    while(getline(_manifest, _line)){
+        size_t _space = _line.find(' ');
+        if(_space == string::npos) return -1;
+        uint64_t _hash;
+        if(!hash_file(_line.substr(_space + 1), _hash) || (to_hex(_hash) != _line.substr(0, _space))) return -1;
+    }
+    
+    string _buf;
+    if(!out8::read_file(dir + "/" + _key + ".out", _buf)) return -1;
+    return out8::write_file(_out, _buf);
+}
+
+void cache8::store(string _in, string _out, const vector<string> &_files){
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0777);
+#endif
+    string _buf;
+    if(!out8::read_file(_out, _buf)) return;
+    
+    uint64_t _key = out8::hash(options);
+    string _manifest;
+    for(uint32_t i = 0; i < _files.size(); i++){
+        uint64_t _hash;
+        if(!hash_file(_files[i], _hash)) return;
+        _manifest += to_hex(_hash) + " " + _files[i] + "\n";
+        _key = out8::hash(_files[i] + "\n" + to_hex(_hash) + "\n", _key);
+    }
+    if(out8::write_file(dir + "/" + to_hex(_key) + ".out", _buf) < 0) return;
+    out8::write_file(manifest_path(_in), to_hex(_key) + "\n" + _manifest);
+}
+
+string cache8::manifest_path(string _in){
+    return dir + "/" + to_hex(out8::hash(options + "\n" + _in)) + ".manifest";
+}
+
+bool cache8::hash_file(string _filename, uint64_t &_hash){
+    string _buf;
+    if(!out8::read_file(_filename, _buf)) return false;
+    _hash = out8::hash(_buf);
+    return true;
+}
+
+string cache8::to_hex(uint64_t _value){
+    char _buf[24];
+    sprintf(_buf, "%016llx", (unsigned long long)_value);
+    return _buf;
+}
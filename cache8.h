@@ -0,0 +1,39 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Build Cache
+ * Content addressed cache of assembled outputs, keyed by all inputs and options
+*/
+
+#ifndef CACHE8_H_
+#define CACHE8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+//Bump when the assembler encodes anything differently, so old entries are
+//not used anymore:
+#define CACHE8_VERSION      1
+
+//An entry is the output file "<key>.out"; the key hashes the options and the
+//name and content of every source file. Which files a build reads is only
+//known afterwards, so "<hash of options and input>.manifest" lists them with
+//their content hashes and the key they led to:
+class cache8{
+    public:
+        string      dir;
+        string      options;
+
+        cache8(string _dir, string _options);
+        int fetch(string _in, string _out);
+        void store(string _in, string _out, const vector<string> &_files);
+        string manifest_path(string _in);
+
+        static bool hash_file(string _filename, uint64_t &_hash);
+        static string to_hex(uint64_t _value);
+};
+
+#endif /* CACHE8_H_ */
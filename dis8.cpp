@@ -0,0 +1,165 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Disassembler
+ * Turns images back into source this assembler reads, byte for byte
+*/
+
+using namespace std;
+
+#include <iostream>
+#include "dis8.h"
+#include "map8.h"
+
+//Mirrors the encoding in asm8::translate_instr(); 0x00 and 0x01 also halt
+//and 0xC0 is also "laa", but only 0xFF and "nop" are emitted for them:
+static constexpr dis8_opcode_t opcode_table[256] = {
+    /* 00 */ {nullptr, 1, DIS8_DATA}, {nullptr, 1, DIS8_DATA}, {"rlc", 1, DIS8_NONE}, {"rfc", 1, DIS8_NONE},
+    /* 04 */ {"adi", 2, DIS8_IMM8}, {"rst 0", 1, DIS8_NONE}, {"lai", 2, DIS8_IMM8}, {"ret", 1, DIS8_NONE},
+    /* 08 */ {"inb", 1, DIS8_NONE}, {"deb", 1, DIS8_NONE}, {"rrc", 1, DIS8_NONE}, {"rfz", 1, DIS8_NONE},
+    /* 0C */ {"aci", 2, DIS8_IMM8}, {"rst 1", 1, DIS8_NONE}, {"lbi", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 10 */ {"inc", 1, DIS8_NONE}, {"dec", 1, DIS8_NONE}, {"ral", 1, DIS8_NONE}, {"rfs", 1, DIS8_NONE},
+    /* 14 */ {"sui", 2, DIS8_IMM8}, {"rst 2", 1, DIS8_NONE}, {"lci", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 18 */ {"ind", 1, DIS8_NONE}, {"ded", 1, DIS8_NONE}, {"rar", 1, DIS8_NONE}, {"rfp", 1, DIS8_NONE},
+    /* 1C */ {"sbi", 2, DIS8_IMM8}, {"rst 3", 1, DIS8_NONE}, {"ldi", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 20 */ {"ine", 1, DIS8_NONE}, {"dee", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"rtc", 1, DIS8_NONE},
+    /* 24 */ {"ndi", 2, DIS8_IMM8}, {"rst 4", 1, DIS8_NONE}, {"lei", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 28 */ {"inh", 1, DIS8_NONE}, {"deh", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"rtz", 1, DIS8_NONE},
+    /* 2C */ {"xri", 2, DIS8_IMM8}, {"rst 5", 1, DIS8_NONE}, {"lhi", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 30 */ {"inl", 1, DIS8_NONE}, {"del", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"rts", 1, DIS8_NONE},
+    /* 34 */ {"ori", 2, DIS8_IMM8}, {"rst 6", 1, DIS8_NONE}, {"lli", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 38 */ {nullptr, 1, DIS8_DATA}, {nullptr, 1, DIS8_DATA}, {nullptr, 1, DIS8_DATA}, {"rtp", 1, DIS8_NONE},
+    /* 3C */ {"cpi", 2, DIS8_IMM8}, {"rst 7", 1, DIS8_NONE}, {"lmi", 2, DIS8_IMM8}, {nullptr, 1, DIS8_DATA},
+    /* 40 */ {"jfc", 3, DIS8_ADDR}, {"inp 0", 1, DIS8_NONE}, {"cfc", 3, DIS8_ADDR}, {"inp 1", 1, DIS8_NONE},
+    /* 44 */ {"jmp", 3, DIS8_ADDR}, {"inp 2", 1, DIS8_NONE}, {"cal", 3, DIS8_ADDR}, {"inp 3", 1, DIS8_NONE},
+    /* 48 */ {"jfz", 3, DIS8_ADDR}, {"inp 4", 1, DIS8_NONE}, {"cfz", 3, DIS8_ADDR}, {"inp 5", 1, DIS8_NONE},
+    /* 4C */ {nullptr, 1, DIS8_DATA}, {"inp 6", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"inp 7", 1, DIS8_NONE},
+    /* 50 */ {"jfs", 3, DIS8_ADDR}, {"out 8", 1, DIS8_NONE}, {"cfs", 3, DIS8_ADDR}, {"out 9", 1, DIS8_NONE},
+    /* 54 */ {nullptr, 1, DIS8_DATA}, {"out 10", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 11", 1, DIS8_NONE},
+    /* 58 */ {"jfp", 3, DIS8_ADDR}, {"out 12", 1, DIS8_NONE}, {"cfp", 3, DIS8_ADDR}, {"out 13", 1, DIS8_NONE},
+    /* 5C */ {nullptr, 1, DIS8_DATA}, {"out 14", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 15", 1, DIS8_NONE},
+    /* 60 */ {"jtc", 3, DIS8_ADDR}, {"out 16", 1, DIS8_NONE}, {"ctc", 3, DIS8_ADDR}, {"out 17", 1, DIS8_NONE},
+    /* 64 */ {nullptr, 1, DIS8_DATA}, {"out 18", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 19", 1, DIS8_NONE},
+    /* 68 */ {"jtz", 3, DIS8_ADDR}, {"out 20", 1, DIS8_NONE}, {"ctz", 3, DIS8_ADDR}, {"out 21", 1, DIS8_NONE},
+    /* 6C */ {nullptr, 1, DIS8_DATA}, {"out 22", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 23", 1, DIS8_NONE},
+    /* 70 */ {"jts", 3, DIS8_ADDR}, {"out 24", 1, DIS8_NONE}, {"cts", 3, DIS8_ADDR}, {"out 25", 1, DIS8_NONE},
+    /* 74 */ {nullptr, 1, DIS8_DATA}, {"out 26", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 27", 1, DIS8_NONE},
+    /* 78 */ {"jtp", 3, DIS8_ADDR}, {"out 28", 1, DIS8_NONE}, {"ctp", 3, DIS8_ADDR}, {"out 29", 1, DIS8_NONE},
+    /* 7C */ {nullptr, 1, DIS8_DATA}, {"out 30", 1, DIS8_NONE}, {nullptr, 1, DIS8_DATA}, {"out 31", 1, DIS8_NONE},
+    /* 80 */ {"ada", 1, DIS8_NONE}, {"adb", 1, DIS8_NONE}, {"adc", 1, DIS8_NONE}, {"add", 1, DIS8_NONE},
+    /* 84 */ {"ade", 1, DIS8_NONE}, {"adh", 1, DIS8_NONE}, {"adl", 1, DIS8_NONE}, {"adm", 1, DIS8_NONE},
+    /* 88 */ {"aca", 1, DIS8_NONE}, {"acb", 1, DIS8_NONE}, {"acc", 1, DIS8_NONE}, {"acd", 1, DIS8_NONE},
+    /* 8C */ {"ace", 1, DIS8_NONE}, {"ach", 1, DIS8_NONE}, {"acl", 1, DIS8_NONE}, {"acm", 1, DIS8_NONE},
+    /* 90 */ {"sua", 1, DIS8_NONE}, {"sub", 1, DIS8_NONE}, {"suc", 1, DIS8_NONE}, {"sud", 1, DIS8_NONE},
+    /* 94 */ {"sue", 1, DIS8_NONE}, {"suh", 1, DIS8_NONE}, {"sul", 1, DIS8_NONE}, {"sum", 1, DIS8_NONE},
+    /* 98 */ {"sba", 1, DIS8_NONE}, {"sbb", 1, DIS8_NONE}, {"sbc", 1, DIS8_NONE}, {"sbd", 1, DIS8_NONE},
+    /* 9C */ {"sbe", 1, DIS8_NONE}, {"sbh", 1, DIS8_NONE}, {"sbl", 1, DIS8_NONE}, {"sbm", 1, DIS8_NONE},
+    /* A0 */ {"nda", 1, DIS8_NONE}, {"ndb", 1, DIS8_NONE}, {"ndc", 1, DIS8_NONE}, {"ndd", 1, DIS8_NONE},
+    /* A4 */ {"nde", 1, DIS8_NONE}, {"ndh", 1, DIS8_NONE}, {"ndl", 1, DIS8_NONE}, {"ndm", 1, DIS8_NONE},
+    /* A8 */ {"xra", 1, DIS8_NONE}, {"xrb", 1, DIS8_NONE}, {"xrc", 1, DIS8_NONE}, {"xrd", 1, DIS8_NONE},
+    /* AC */ {"xre", 1, DIS8_NONE}, {"xrh", 1, DIS8_NONE}, {"xrl", 1, DIS8_NONE}, {"xrm", 1, DIS8_NONE},
+    /* B0 */ {"ora", 1, DIS8_NONE}, {"orb", 1, DIS8_NONE}, {"orc", 1, DIS8_NONE}, {"ord", 1, DIS8_NONE},
+    /* B4 */ {"ore", 1, DIS8_NONE}, {"orh", 1, DIS8_NONE}, {"orl", 1, DIS8_NONE}, {"orm", 1, DIS8_NONE},
+    /* B8 */ {"cpa", 1, DIS8_NONE}, {"cpb", 1, DIS8_NONE}, {"cpc", 1, DIS8_NONE}, {"cpd", 1, DIS8_NONE},
+    /* BC */ {"cpe", 1, DIS8_NONE}, {"cph", 1, DIS8_NONE}, {"cpl", 1, DIS8_NONE}, {"cpm", 1, DIS8_NONE},
+    /* C0 */ {"nop", 1, DIS8_NONE}, {"lab", 1, DIS8_NONE}, {"lac", 1, DIS8_NONE}, {"lad", 1, DIS8_NONE},
+    /* C4 */ {"lae", 1, DIS8_NONE}, {"lah", 1, DIS8_NONE}, {"lal", 1, DIS8_NONE}, {"lam", 1, DIS8_NONE},
+    /* C8 */ {"lba", 1, DIS8_NONE}, {"lbb", 1, DIS8_NONE}, {"lbc", 1, DIS8_NONE}, {"lbd", 1, DIS8_NONE},
+    /* CC */ {"lbe", 1, DIS8_NONE}, {"lbh", 1, DIS8_NONE}, {"lbl", 1, DIS8_NONE}, {"lbm", 1, DIS8_NONE},
+    /* D0 */ {"lca", 1, DIS8_NONE}, {"lcb", 1, DIS8_NONE}, {"lcc", 1, DIS8_NONE}, {"lcd", 1, DIS8_NONE},
+    /* D4 */ {"lce", 1, DIS8_NONE}, {"lch", 1, DIS8_NONE}, {"lcl", 1, DIS8_NONE}, {"lcm", 1, DIS8_NONE},
+    /* D8 */ {"lda", 1, DIS8_NONE}, {"ldb", 1, DIS8_NONE}, {"ldc", 1, DIS8_NONE}, {"ldd", 1, DIS8_NONE},
+    /* DC */ {"lde", 1, DIS8_NONE}, {"ldh", 1, DIS8_NONE}, {"ldl", 1, DIS8_NONE}, {"ldm", 1, DIS8_NONE},
+    /* E0 */ {"lea", 1, DIS8_NONE}, {"leb", 1, DIS8_NONE}, {"lec", 1, DIS8_NONE}, {"led", 1, DIS8_NONE},
+    /* E4 */ {"lee", 1, DIS8_NONE}, {"leh", 1, DIS8_NONE}, {"lel", 1, DIS8_NONE}, {"lem", 1, DIS8_NONE},
+    /* E8 */ {"lha", 1, DIS8_NONE}, {"lhb", 1, DIS8_NONE}, {"lhc", 1, DIS8_NONE}, {"lhd", 1, DIS8_NONE},
+    /* EC */ {"lhe", 1, DIS8_NONE}, {"lhh", 1, DIS8_NONE}, {"lhl", 1, DIS8_NONE}, {"lhm", 1, DIS8_NONE},
+    /* F0 */ {"lla", 1, DIS8_NONE}, {"llb", 1, DIS8_NONE}, {"llc", 1, DIS8_NONE}, {"lld", 1, DIS8_NONE},
+    /* F4 */ {"lle", 1, DIS8_NONE}, {"llh", 1, DIS8_NONE}, {"lll", 1, DIS8_NONE}, {"llm", 1, DIS8_NONE},
+    /* F8 */ {"lma", 1, DIS8_NONE}, {"lmb", 1, DIS8_NONE}, {"lmc", 1, DIS8_NONE}, {"lmd", 1, DIS8_NONE},
+    /* FC */ {"lme", 1, DIS8_NONE}, {"lmh", 1, DIS8_NONE}, {"lml", 1, DIS8_NONE}, {"halt", 1, DIS8_NONE}
+};
+
+static_assert(opcode_table[0x44].size == 3 && opcode_table[0x46].operand == DIS8_ADDR, "jmp and cal take an address");
+static_assert(opcode_table[0xC0].size == 1 && opcode_table[0xFF].size == 1, "nop and halt are one byte");
+static_assert(opcode_table[0x3E].operand == DIS8_IMM8 && opcode_table[0x3F].operand == DIS8_DATA, "lmi takes a byte, 0x3F is not emitted");
+
+const dis8_opcode_t &dis8::opcode(uint8_t _byte){
+    return opcode_table[_byte];
+}
+
+void dis8::add_label(uint32_t _address, string _name){
+    labels[_address].push_back(_name);
+}
+
+//Takes the labels of a binary map written with -M:
+bool dis8::load_map(string _filename){
+    map8 _map;
+    if(!_map.open(_filename)) return false;
+    for(uint32_t i = 0; i < _map.get_u32(12); i++){
+        size_t _pos = _map.record(1, i);
+        if(_map.data[_pos + 8] == map_symbol_t::symbol_label) add_label(_map.get_u32(_pos + 4), _map.get_string(_map.get_u32(_pos)));
+    }
+    _map.close();
+    return true;
+}
+
+string dis8::disassemble(const vector<uint8_t> &_image){
+    string _source;
+    _source.reserve(_image.size() * 24);
+    //Labels past the end of the image, like .dsb variables, become defines:
+    map<uint32_t, vector<string>>::const_iterator _label = labels.lower_bound(_image.size() + 1);
+    for(; _label != labels.end(); _label++)
+        for(uint32_t i = 0; i < _label->second.size(); i++) _source += ".define " + _label->second[i] + " " + hex(_label->first, 4) + "\n";
+    _label = labels.begin();
+    string _line;
+    for(uint32_t _pos = 0; _pos < _image.size();){
+        while((_label != labels.end()) && (_label->first <= _pos)){
+            if(_label->first == _pos) for(uint32_t i = 0; i < _label->second.size(); i++) _source += _label->second[i] + ":\n";
+            _label++;
+        }
+        //An instruction that would cover a label is written as data, so the label keeps its address:
+        uint32_t _next = (_label != labels.end()) ? _label->first : UINT32_MAX;
+        uint32_t _size = decode(_image, _pos, _line);
+        if(_pos + _size > _next){
+            _line = "    .db " + hex(_image[_pos], 2);
+            _size = 1;
+        }
+
+        _source += _line;
+        _source.append((_line.length() < 24) ? (24 - _line.length()) : 1, ' ');
+        _source += "; " + hex(_pos, 4) + " ";
+        for(uint32_t i = 0; i < _size; i++) _source += " " + hex(_image[_pos + i], 2).substr(2);
+        _source += "\n";
+        _pos += _size;
+    }
+    if((_label != labels.end()) && (_label->first == _image.size()))
+        for(uint32_t i = 0; i < _label->second.size(); i++) _source += _label->second[i] + ":\n";
+    return _source;
+}
+
+//Decodes the instruction at _pos into one source line and returns its size;
+//one that runs past the end of the image is written as data:
+uint32_t dis8::decode(const vector<uint8_t> &_image, uint32_t _pos, string &_line){
+    const dis8_opcode_t &_op = opcode_table[_image[_pos]];
+    if((_op.operand == DIS8_DATA) || (_pos + _op.size > _image.size())){
+        _line = "    .db " + hex(_image[_pos], 2);
+        return 1;
+    }
+    _line = string("    ") + _op.mnemonic;
+    if(_op.operand == DIS8_IMM8){
+        _line += " " + hex(_image[_pos + 1], 2);
+    }
+    else if(_op.operand == DIS8_ADDR){
+        uint32_t _addr = _image[_pos + 1] | (_image[_pos + 2] << 8);
+        map<uint32_t, vector<string>>::const_iterator _it = labels.find(_addr);
+        _line += " " + ((_it != labels.end()) ? _it->second[0] : hex(_addr, 4));
+    }
+    return _op.size;
+}
+
+string dis8::hex(uint32_t _value, uint32_t _digits){
+    const char _digit[] = "0123456789ABCDEF";
+    string _hex = "0x";
+    for(uint32_t i = _digits; i > 0; i--) _hex += _digit[(_value >> ((i - 1) * 4)) & 0xF];
+    return _hex;
+}
@@ -0,0 +1,48 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Disassembler
+ * Turns images back into source this assembler reads, byte for byte
+*/
+
+#ifndef DIS8_H_
+#define DIS8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <stdint.h>
+
+#define DIS8_NONE   0
+#define DIS8_IMM8   1
+#define DIS8_ADDR   2
+#define DIS8_DATA   3
+
+//One opcode: the mnemonic as translate_instr() reads it (ports and restart
+//vectors are part of it), the instruction size and what the operand bytes
+//hold. Opcodes translate_instr() never emits have no mnemonic and are
+//written as .db, so they assemble to the same byte again:
+class dis8_opcode_t{
+    public:
+        const char  *mnemonic;
+        uint8_t     size;
+        uint8_t     operand;
+};
+
+class dis8{
+    public:
+        //Labels by address, all of them are written, the first one names operands:
+        map<uint32_t, vector<string>>   labels;
+
+        void add_label(uint32_t _address, string _name);
+        bool load_map(string _filename);
+        string disassemble(const vector<uint8_t> &_image);
+        uint32_t decode(const vector<uint8_t> &_image, uint32_t _pos, string &_line);
+
+        static const dis8_opcode_t &opcode(uint8_t _byte);
+        static string hex(uint32_t _value, uint32_t _digits);
+};
+
+#endif /* DIS8_H_ */
@@ -0,0 +1,427 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Built-in Intel 8008 Emulator
+ * Runs assembled images with a predecoded, threaded dispatch loop
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include "emu8.h"
+
+//Register index 7 (M) is never stored in reg[], it addresses memory via H and L:
+#define REG_A   0
+#define REG_H   5
+#define REG_L   6
+#define REG_M   7
+
+static bool parity_even[256];
+
+emu8::emu8(){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t _bits = 0;
+        for(uint32_t j = 0; j < 8; j++) _bits += (i >> j) & 1;
+        parity_even[i] = ((_bits & 1) == 0);
+    }
+    for(uint32_t i = 0; i < EMU8_OUTPUT_PORTS; i++) out_echo[i] = false;
+    profile = false;
+    memset(mem, 0, sizeof(mem));
+    for(uint32_t i = 0; i < EMU8_MEMORY_SIZE; i++) decode(i);
+    reset();
+}
+
+void emu8::reset(){
+    memset(reg, 0, sizeof(reg));
+    memset(stack, 0, sizeof(stack));
+    sp = 0;
+    flag_c = flag_z = flag_s = flag_p = false;
+    cycles = 0;
+    instructions = 0;
+    stop = stop_none;
+    for(uint32_t i = 0; i < EMU8_INPUT_PORTS; i++) in_pos[i] = 0;
+    for(uint32_t i = 0; i < EMU8_OUTPUT_PORTS; i++) out_data[i].clear();
+    prof_count.assign(EMU8_MEMORY_SIZE, 0);
+    prof_cycles.assign(EMU8_MEMORY_SIZE, 0);
+}
+
+void emu8::load(const vector<uint8_t> &_image, uint16_t _addr){
+    for(uint32_t i = 0; (i < _image.size()) && (_addr + i < EMU8_MEMORY_SIZE); i++) mem[_addr + i] = _image[i];
+    for(uint32_t i = 0; i < EMU8_MEMORY_SIZE; i++) decode(i);
+}
+
+void emu8::write_mem(uint16_t _addr, uint8_t _value){
+    _addr &= EMU8_ADDRESS_MASK;
+    mem[_addr] = _value;
+    //The written byte can be the opcode or an operand of up to two instructions before it:
+    decode(_addr);
+    decode((_addr - 1) & EMU8_ADDRESS_MASK);
+    decode((_addr - 2) & EMU8_ADDRESS_MASK);
+}
+
+void emu8::decode(uint16_t _addr){
+    decoded_t &_d = decoded[_addr];
+    uint8_t _byte = mem[_addr];
+    uint8_t _low = _byte & 0x07;
+    uint8_t _mid = (_byte >> 3) & 0x07;
+    uint8_t _size = 1;
+
+    _d.a = 0; _d.b = 0; _d.imm = 0;
+    _d.cycles = 5; _d.cycles_alt = 5;
+    _d.op = op_illegal;
+
+    switch(_byte >> 6){
+        case 0:
+            if((_byte == 0x00) || (_byte == 0x01)){
+                _d.op = op_hlt; _d.cycles = _d.cycles_alt = 4;
+            }
+            else if(_low == 0){
+                _d.op = op_inr; _d.a = _mid;
+            }
+            else if(_low == 1){
+                _d.op = op_dcr; _d.a = _mid;
+            }
+            else if(_low == 2){
+                if(_mid == 0)       _d.op = op_rlc;
+                else if(_mid == 1)  _d.op = op_rrc;
+                else if(_mid == 2)  _d.op = op_ral;
+                else if(_mid == 3)  _d.op = op_rar;
+            }
+            else if(_low == 3){
+                _d.op = (_mid < 4) ? op_rfc : op_rtc; _d.a = _mid & 0x03;
+                _d.cycles = 5; _d.cycles_alt = 3;
+            }
+            else if(_low == 4){
+                _d.op = op_alui; _d.a = _mid; _size = 2;
+                _d.cycles = _d.cycles_alt = 8;
+            }
+            else if(_low == 5){
+                _d.op = op_rst; _d.imm = _mid << 3;
+            }
+            else if(_low == 6){
+                _d.op = (_mid == REG_M) ? op_lmi : op_lri; _d.a = _mid; _size = 2;
+                _d.cycles = _d.cycles_alt = (_mid == REG_M) ? 9 : 8;
+            }
+            else{
+                _d.op = op_ret;
+            }
+            break;
+        case 1:
+            if(_byte & 0x01){
+                uint8_t _port = (_byte >> 1) & 0x1F;
+                _d.op = (_port < 8) ? op_inp : op_out; _d.a = _port;
+                _d.cycles = _d.cycles_alt = (_port < 8) ? 8 : 6;
+            }
+            else if(_low == 0){
+                _d.op = (_mid < 4) ? op_jfc : op_jtc; _d.a = _mid & 0x03; _size = 3;
+                _d.cycles = 11; _d.cycles_alt = 9;
+            }
+            else if(_low == 2){
+                _d.op = (_mid < 4) ? op_cfc : op_ctc; _d.a = _mid & 0x03; _size = 3;
+                _d.cycles = 11; _d.cycles_alt = 9;
+            }
+            else if(_low == 4){
+                _d.op = op_jmp; _size = 3; _d.cycles = _d.cycles_alt = 11;
+            }
+            else if(_low == 6){
+                _d.op = op_cal; _size = 3; _d.cycles = _d.cycles_alt = 11;
+            }
+            break;
+        case 2:
+            _d.op = (_low == REG_M) ? op_alum : op_alur; _d.a = _mid; _d.b = _low;
+            _d.cycles = _d.cycles_alt = (_low == REG_M) ? 8 : 5;
+            break;
+        case 3:
+            if(_byte == 0xFF){
+                _d.op = op_hlt; _d.cycles = _d.cycles_alt = 4;
+            }
+            else if(_mid == REG_M){
+                _d.op = op_lmr; _d.b = _low; _d.cycles = _d.cycles_alt = 7;
+            }
+            else if(_low == REG_M){
+                _d.op = op_lrm; _d.a = _mid; _d.cycles = _d.cycles_alt = 8;
+            }
+            else{
+                _d.op = op_lrr; _d.a = _mid; _d.b = _low;
+            }
+            break;
+    }
+
+    if(_size == 2)      _d.imm = mem[(_addr + 1) & EMU8_ADDRESS_MASK];
+    else if(_size == 3) _d.imm = (mem[(_addr + 1) & EMU8_ADDRESS_MASK] | (mem[(_addr + 2) & EMU8_ADDRESS_MASK] << 8)) & EMU8_ADDRESS_MASK;
+    _d.next = (_addr + _size) & EMU8_ADDRESS_MASK;
+}
+
+void emu8::set_input(uint8_t _port, vector<uint8_t> _data){
+    if(_port >= EMU8_INPUT_PORTS) return;
+    in_data[_port] = _data;
+    in_pos[_port] = 0;
+}
+
+uint8_t emu8::port_in(uint8_t _port){
+    if(in_data[_port].size() < 1) return 0;
+    if(in_pos[_port] < in_data[_port].size()) return in_data[_port][in_pos[_port]++];
+    return in_data[_port].back();
+}
+
+void emu8::port_out(uint8_t _port, uint8_t _value){
+    out_data[_port].push_back(_value);
+    if(out_echo[_port]) cout.put(_value);
+}
+
+uint16_t emu8::get_pc(){
+    return stack[sp];
+}
+
+emu8::stop_reason emu8::run(uint64_t _max_cycles){
+    if(profile) return run_loop<true>(_max_cycles);
+    else        return run_loop<false>(_max_cycles);
+}
+
+//The profiling hooks are compiled out of the run_loop<false> instance:
+template<bool _profile> emu8::stop_reason emu8::run_loop(uint64_t _max_cycles){
+    uint16_t _pc = stack[sp];
+    uint64_t _cycles = cycles;
+    uint64_t _instructions = instructions;
+    uint16_t _prof_pc = _pc;
+    uint64_t _prof_cycles = _cycles;
+    uint8_t _value = 0;
+    uint16_t _result;
+    bool _cond = false;
+    const decoded_t *_d;
+
+    stop = stop_none;
+
+//Each handler ends with EMU8_NEXT(), which either jumps straight to the
+//handler of the next instruction or falls back to the switch loop:
+#ifdef EMU8_THREADED_DISPATCH
+    static const void *_dispatch[op_count] = {
+        &&L_op_lrr, &&L_op_lrm, &&L_op_lmr, &&L_op_lri, &&L_op_lmi,
+        &&L_op_inr, &&L_op_dcr,
+        &&L_op_alur, &&L_op_alum, &&L_op_alui,
+        &&L_op_rlc, &&L_op_rrc, &&L_op_ral, &&L_op_rar,
+        &&L_op_jmp, &&L_op_jfc, &&L_op_jtc, &&L_op_cal, &&L_op_cfc, &&L_op_ctc,
+        &&L_op_ret, &&L_op_rfc, &&L_op_rtc, &&L_op_rst,
+        &&L_op_inp, &&L_op_out, &&L_op_hlt, &&L_op_illegal
+    };
+    #define EMU8_OP(_op)    L_##_op:
+    #define EMU8_NEXT()     do{ if(_profile) EMU8_PROFILE(); if(_cycles >= _max_cycles) goto budget; _d = &decoded[_pc]; _instructions++; goto *_dispatch[_d->op]; }while(0)
+#else
+    #define EMU8_OP(_op)    case _op:
+    #define EMU8_NEXT()     continue
+#endif
+    #define EMU8_PROFILE()  do{ prof_cycles[_prof_pc] += _cycles - _prof_cycles; prof_count[_pc]++; _prof_pc = _pc; _prof_cycles = _cycles; }while(0)
+#ifdef EMU8_THREADED_DISPATCH
+    EMU8_NEXT();
+#else
+    for(;;){
+        if(_profile) EMU8_PROFILE();
+        if(_cycles >= _max_cycles) goto budget;
+        _d = &decoded[_pc];
+        _instructions++;
+        switch(_d->op){
+#endif
+
+    EMU8_OP(op_lrr)
+        reg[_d->a] = reg[_d->b];
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_lrm)
+        reg[_d->a] = mem[((reg[REG_H] << 8) | reg[REG_L]) & EMU8_ADDRESS_MASK];
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_lmr)
+        _cycles += _d->cycles; _pc = _d->next;
+        write_mem((reg[REG_H] << 8) | reg[REG_L], reg[_d->b]);
+        EMU8_NEXT();
+    EMU8_OP(op_lri)
+        reg[_d->a] = _d->imm;
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_lmi)
+        _cycles += _d->cycles; _pc = _d->next;
+        write_mem((reg[REG_H] << 8) | reg[REG_L], _d->imm);
+        EMU8_NEXT();
+    EMU8_OP(op_inr)
+        _value = ++reg[_d->a];
+        flag_z = (_value == 0); flag_s = (_value & 0x80); flag_p = parity_even[_value];
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_dcr)
+        _value = --reg[_d->a];
+        flag_z = (_value == 0); flag_s = (_value & 0x80); flag_p = parity_even[_value];
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_alur)
+        _value = reg[_d->b];
+        goto alu;
+    EMU8_OP(op_alum)
+        _value = mem[((reg[REG_H] << 8) | reg[REG_L]) & EMU8_ADDRESS_MASK];
+        goto alu;
+    EMU8_OP(op_alui)
+        _value = _d->imm;
+    alu:
+        switch(_d->a){
+            case alu_add: _result = reg[REG_A] + _value;            flag_c = (_result > 0xFF); reg[REG_A] = _result; break;
+            case alu_adc: _result = reg[REG_A] + _value + flag_c;   flag_c = (_result > 0xFF); reg[REG_A] = _result; break;
+            case alu_sub: _result = reg[REG_A] - _value;            flag_c = (_result > 0xFF); reg[REG_A] = _result; break;
+            case alu_sbc: _result = reg[REG_A] - _value - flag_c;   flag_c = (_result > 0xFF); reg[REG_A] = _result; break;
+            case alu_and: reg[REG_A] &= _value; flag_c = false; break;
+            case alu_xor: reg[REG_A] ^= _value; flag_c = false; break;
+            case alu_or:  reg[REG_A] |= _value; flag_c = false; break;
+            case alu_cp:
+                _result = reg[REG_A] - _value; flag_c = (_result > 0xFF);
+                _value = _result;
+                flag_z = (_value == 0); flag_s = (_value & 0x80); flag_p = parity_even[_value];
+                _cycles += _d->cycles; _pc = _d->next;
+                EMU8_NEXT();
+        }
+        _value = reg[REG_A];
+        flag_z = (_value == 0); flag_s = (_value & 0x80); flag_p = parity_even[_value];
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_rlc)
+        flag_c = reg[REG_A] >> 7;
+        reg[REG_A] = (reg[REG_A] << 1) | flag_c;
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_rrc)
+        flag_c = reg[REG_A] & 0x01;
+        reg[REG_A] = (reg[REG_A] >> 1) | (flag_c << 7);
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_ral)
+        _value = reg[REG_A];
+        reg[REG_A] = (_value << 1) | flag_c;
+        flag_c = _value >> 7;
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_rar)
+        _value = reg[REG_A];
+        reg[REG_A] = (_value >> 1) | (flag_c << 7);
+        flag_c = _value & 0x01;
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_jmp)
+        _cycles += _d->cycles; _pc = _d->imm;
+        EMU8_NEXT();
+    EMU8_OP(op_jfc)
+    EMU8_OP(op_jtc)
+        switch(_d->a){
+            case 0: _cond = flag_c; break;
+            case 1: _cond = flag_z; break;
+            case 2: _cond = flag_s; break;
+            case 3: _cond = flag_p; break;
+        }
+        if(_cond == (_d->op == op_jtc)){ _cycles += _d->cycles; _pc = _d->imm; }
+        else{ _cycles += _d->cycles_alt; _pc = _d->next; }
+        EMU8_NEXT();
+    EMU8_OP(op_cal)
+        _cycles += _d->cycles;
+        stack[sp] = _d->next; sp = (sp + 1) & (EMU8_STACK_SIZE - 1); _pc = _d->imm;
+        EMU8_NEXT();
+    EMU8_OP(op_cfc)
+    EMU8_OP(op_ctc)
+        switch(_d->a){
+            case 0: _cond = flag_c; break;
+            case 1: _cond = flag_z; break;
+            case 2: _cond = flag_s; break;
+            case 3: _cond = flag_p; break;
+        }
+        if(_cond == (_d->op == op_ctc)){
+            _cycles += _d->cycles;
+            stack[sp] = _d->next; sp = (sp + 1) & (EMU8_STACK_SIZE - 1); _pc = _d->imm;
+        }
+        else{ _cycles += _d->cycles_alt; _pc = _d->next; }
+        EMU8_NEXT();
+    EMU8_OP(op_ret)
+        _cycles += _d->cycles;
+        sp = (sp - 1) & (EMU8_STACK_SIZE - 1); _pc = stack[sp];
+        EMU8_NEXT();
+    EMU8_OP(op_rfc)
+    EMU8_OP(op_rtc)
+        switch(_d->a){
+            case 0: _cond = flag_c; break;
+            case 1: _cond = flag_z; break;
+            case 2: _cond = flag_s; break;
+            case 3: _cond = flag_p; break;
+        }
+        if(_cond == (_d->op == op_rtc)){
+            _cycles += _d->cycles;
+            sp = (sp - 1) & (EMU8_STACK_SIZE - 1); _pc = stack[sp];
+        }
+        else{ _cycles += _d->cycles_alt; _pc = _d->next; }
+        EMU8_NEXT();
+    EMU8_OP(op_rst)
+        _cycles += _d->cycles;
+        stack[sp] = _d->next; sp = (sp + 1) & (EMU8_STACK_SIZE - 1); _pc = _d->imm;
+        EMU8_NEXT();
+    EMU8_OP(op_inp)
+        reg[REG_A] = port_in(_d->a);
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_out)
+        port_out(_d->a, reg[REG_A]);
+        _cycles += _d->cycles; _pc = _d->next;
+        EMU8_NEXT();
+    EMU8_OP(op_hlt)
+        _cycles += _d->cycles; _pc = _d->next;
+        stop = stop_halt;
+        goto done;
+    EMU8_OP(op_illegal)
+        _instructions--;
+        stop = stop_illegal;
+        goto done;
+
+#ifndef EMU8_THREADED_DISPATCH
+            default:
+                stop = stop_illegal;
+                goto done;
+        }
+    }
+#endif
+    #undef EMU8_OP
+    #undef EMU8_NEXT
+    #undef EMU8_PROFILE
+
+budget:
+    stop = stop_cycle_budget;
+done:
+    if(_profile){
+        prof_cycles[_prof_pc] += _cycles - _prof_cycles;
+        if(stop == stop_cycle_budget) prof_count[_pc]--;
+    }
+    stack[sp] = _pc;
+    cycles = _cycles;
+    instructions = _instructions;
+    return stop;
+}
+
+void emu8::print_state(){
+    char _buf[128];
+    cout << "--------------------------------" << endl;
+    if(stop == stop_halt)               cout << "Halted";
+    else if(stop == stop_cycle_budget)  cout << "Cycle budget exhausted";
+    else if(stop == stop_illegal)       cout << "Illegal opcode";
+    else                                cout << "Stopped";
+    sprintf(_buf, " at PC=0x%04X (opcode 0x%02X)", get_pc(), mem[get_pc()]);
+    cout << _buf << endl;
+    cout << "\tCycles:      \t" << cycles << endl;
+    cout << "\tInstructions:\t" << instructions << endl;
+    sprintf(_buf, "\tA=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X  C%d Z%d S%d P%d  SP=%d",
+            reg[0], reg[1], reg[2], reg[3], reg[4], reg[5], reg[6],
+            flag_c, flag_z, flag_s, flag_p, sp);
+    cout << _buf << endl;
+    for(uint32_t i = 0; i < EMU8_OUTPUT_PORTS; i++){
+        if(out_data[i].size() < 1) continue;
+        cout << "\tOUT " << i << ":\t";
+        for(uint32_t j = 0; (j < out_data[i].size()) && (j < 32); j++){
+            sprintf(_buf, "%02X ", out_data[i][j]);
+            cout << _buf;
+        }
+        if(out_data[i].size() > 32) cout << "... (" << out_data[i].size() << " bytes)";
+        cout << endl;
+    }
+    cout << "--------------------------------" << endl;
+}
@@ -0,0 +1,97 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Built-in Intel 8008 Emulator
+ * Runs assembled images with a predecoded, threaded dispatch loop
+*/
+
+#ifndef EMU8_H_
+#define EMU8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define EMU8_THREADED_DISPATCH
+#endif
+
+#define EMU8_MEMORY_SIZE        0x4000
+#define EMU8_ADDRESS_MASK       0x3FFF
+#define EMU8_STACK_SIZE         8
+#define EMU8_INPUT_PORTS        8
+#define EMU8_OUTPUT_PORTS       32
+
+class emu8{
+    public:
+        enum op_type {
+            op_lrr, op_lrm, op_lmr, op_lri, op_lmi,
+            op_inr, op_dcr,
+            op_alur, op_alum, op_alui,
+            op_rlc, op_rrc, op_ral, op_rar,
+            op_jmp, op_jfc, op_jtc, op_cal, op_cfc, op_ctc,
+            op_ret, op_rfc, op_rtc, op_rst,
+            op_inp, op_out, op_hlt, op_illegal,
+            op_count
+        };
+        enum alu_type {
+            alu_add, alu_adc, alu_sub, alu_sbc, alu_and, alu_xor, alu_or, alu_cp
+        };
+        enum stop_reason {
+            stop_none, stop_halt, stop_cycle_budget, stop_illegal
+        };
+
+        //One entry per address, rebuilt whenever one of its bytes is written:
+        struct decoded_t {
+            uint8_t     op;
+            uint8_t     a;
+            uint8_t     b;
+            uint8_t     cycles;
+            uint8_t     cycles_alt;
+            uint16_t    imm;
+            uint16_t    next;
+        };
+
+        uint8_t     mem[EMU8_MEMORY_SIZE];
+        decoded_t   decoded[EMU8_MEMORY_SIZE];
+
+        uint8_t     reg[8];
+        uint16_t    stack[EMU8_STACK_SIZE];
+        uint8_t     sp;
+        bool        flag_c, flag_z, flag_s, flag_p;
+
+        uint64_t    cycles;
+        uint64_t    instructions;
+        stop_reason stop;
+
+        //Port stub model: every input port replays its byte sequence and then
+        //keeps returning the last byte; output ports record what was written:
+        vector<uint8_t> in_data[EMU8_INPUT_PORTS];
+        uint32_t        in_pos[EMU8_INPUT_PORTS];
+        vector<uint8_t> out_data[EMU8_OUTPUT_PORTS];
+        bool            out_echo[EMU8_OUTPUT_PORTS];
+
+        //Per-address execution counts and T-states, filled when profile is set:
+        bool                profile;
+        vector<uint64_t>    prof_count;
+        vector<uint64_t>    prof_cycles;
+
+        emu8();
+        void reset();
+        void load(const vector<uint8_t> &_image, uint16_t _addr = 0);
+        void write_mem(uint16_t _addr, uint8_t _value);
+        void decode(uint16_t _addr);
+
+        void set_input(uint8_t _port, vector<uint8_t> _data);
+        uint8_t port_in(uint8_t _port);
+        void port_out(uint8_t _port, uint8_t _value);
+
+        stop_reason run(uint64_t _max_cycles);
+        template<bool _profile> stop_reason run_loop(uint64_t _max_cycles);
+        uint16_t get_pc();
+        void print_state();
+};
+
+#endif /* EMU8_H_ */
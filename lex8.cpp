@@ -0,0 +1,318 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Line Scanner
+ * Lowercases and splits source text into lines of words, 64 bytes at a time
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include "lex8.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LEX8_SSE2
+#endif
+
+//The AVX2 block is built with a target attribute, so an SSE2 build still
+//uses it on CPUs that have AVX2; with -mavx2 it is taken without a check:
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LEX8_AVX2
+#define LEX8_AVX2_TARGET
+#elif defined(LEX8_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LEX8_AVX2
+#define LEX8_AVX2_TARGET    __attribute__((target("avx2")))
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+lex8_table_t::lex8_table_t(){
+    const string _special_char = READ8_SPECIAL_CHAR;
+    for(uint32_t i = 0; i < 256; i++){
+        lower[i] = ((i >= 'A') && (i <= 'Z')) ? (i + 0x20) : i;
+        classes[i] = 0;
+        if((i == ' ') || ((i >= 0x09) && (i <= 0x0D)) || (i == 0)) classes[i] |= LEX8_SPACE;
+        if((i == '\n') || (i == '\r')) classes[i] |= LEX8_NEWLINE;
+        if(i == ';') classes[i] |= LEX8_COMMENT;
+        if((i != 0) && (_special_char.find((char)i) != string::npos)) classes[i] |= LEX8_SPECIAL;
+    }
+}
+
+const lex8_table_t &lex8::table(){
+    static const lex8_table_t _table;
+    return _table;
+}
+
+bool lex8::avx2(){
+#if defined(__AVX2__)
+    return true;
+#elif defined(LEX8_AVX2)
+    static const bool _avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return _avx2;
+#else
+    return false;
+#endif
+}
+
+const char *lex8::simd_name(){
+#if defined(LEX8_SSE2)
+    return avx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+//"\r\n" ends one line, a lone '\r' or '\n' ends one too; a ';' drops the
+//rest of the line. Only the bytes that end a word are visited, the word
+//bytes in between are copied in one go. The scalar and SIMD blocks give the
+//same masks, so both go through here:
+void lex8::scan(string &_content, vector<line_t> &_lines, bool _simd){
+    const lex8_table_t &_table = table();
+    uint8_t *_data = (uint8_t*)_content.data();
+    size_t _length = _content.length();
+
+    line_t _line;
+    size_t _start = 0;
+    bool _comment = false;
+    for(size_t _block = 0; _block < _length; _block += LEX8_BLOCK){
+        uint32_t _size = ((_length - _block) < LEX8_BLOCK) ? (_length - _block) : LEX8_BLOCK;
+        uint64_t _newline;
+        uint64_t _all = (_simd && (_size == LEX8_BLOCK)) ? block_simd(_data + _block, _newline) : block_scalar(_data + _block, _size, _newline);
+        uint64_t _mask = _comment ? (_all & _newline) : _all;
+
+        while(_mask != 0){
+            uint32_t _bit = lowest_bit(_mask);
+            _mask &= _mask - 1;
+            size_t i = _block + _bit;
+            uint8_t _class = _table.classes[_data[i]];
+
+            if(_comment){
+                //Only line ends are left in the mask, the other bytes of this block count again:
+                _comment = false;
+                _mask = _all & ~((2ULL << _bit) - 1);
+            }
+            else if(i > _start){
+                _line.push_back(string((const char*)_data + _start, i - _start));
+            }
+            _start = i + 1;
+
+            if(_class & LEX8_NEWLINE){
+                //The '\n' behind it ends the line, even in the next block:
+                if((_data[i] == '\r') && (i + 1 < _length) && (_data[i + 1] == '\n')) continue;
+                _lines.push_back(move(_line));
+                _line.clear();
+            }
+            else if(_class & LEX8_COMMENT){
+                _comment = true;
+                _mask &= _newline;
+            }
+            else if(_class & LEX8_SPECIAL){
+                _line.push_back(string(1, (char)_data[i]));
+            }
+        }
+    }
+    if(!_comment && (_length > _start)) _line.push_back(string((const char*)_data + _start, _length - _start));
+    _lines.push_back(move(_line));
+}
+
+//Splits one word at the special characters, for words that were put
+//together after lexing:
+void lex8::split(const string &_word, line_t &_code){
+    const lex8_table_t &_table = table();
+    size_t _start = 0;
+    for(size_t i = 0; i <= _word.length(); i++){
+        uint8_t _class = (i < _word.length()) ? _table.classes[(uint8_t)_word[i]] : LEX8_SPACE;
+        if(_class == 0) continue;
+        if(i > _start) _code.push_back(_word.substr(_start, i - _start));
+        if(_class & LEX8_SPECIAL) _code.push_back(string(1, _word[i]));
+        _start = i + 1;
+    }
+}
+
+//Lowercases the block in place and returns one bit per byte that ends a
+//word; _newline gets the bits of the line ends:
+uint64_t lex8::block_scalar(uint8_t *_data, uint32_t _length, uint64_t &_newline){
+    const lex8_table_t &_table = table();
+    uint64_t _mask = 0;
+    _newline = 0;
+    for(uint32_t i = 0; i < _length; i++){
+        uint8_t _class = _table.classes[_data[i]];
+        _data[i] = _table.lower[_data[i]];
+        if(_class != 0) _mask |= (1ULL << i);
+        if(_class & LEX8_NEWLINE) _newline |= (1ULL << i);
+    }
+    return _mask;
+}
+
+#if defined(LEX8_AVX2)
+//Unsigned _lo <= x <= _lo + _range as a byte mask:
+LEX8_AVX2_TARGET static inline __m256i lex8_in_range(__m256i _v, uint8_t _lo, uint8_t _range){
+    __m256i _t = _mm256_sub_epi8(_v, _mm256_set1_epi8((char)_lo));
+    __m256i _r = _mm256_set1_epi8((char)_range);
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(_t, _r), _r);
+}
+
+LEX8_AVX2_TARGET static uint64_t lex8_block_avx2(uint8_t *_data, uint64_t &_newline){
+    static const char _special_char[] = READ8_SPECIAL_CHAR;
+    __m256i _special[sizeof(_special_char) - 1];
+    for(uint32_t k = 0; k < sizeof(_special_char) - 1; k++) _special[k] = _mm256_set1_epi8(_special_char[k]);
+    uint64_t _mask = 0, _lines = 0;
+    for(uint32_t _half = 0; _half < 2; _half++){
+        __m256i *_p = (__m256i*)(_data + _half * 32);
+        __m256i _v = _mm256_loadu_si256(_p);
+        __m256i _upper = lex8_in_range(_v, 'A', 'Z' - 'A');
+        _v = _mm256_or_si256(_v, _mm256_and_si256(_upper, _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256(_p, _v);
+
+        __m256i _lf = _mm256_or_si256(_mm256_cmpeq_epi8(_v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(_v, _mm256_set1_epi8('\r')));
+        __m256i _end = _mm256_or_si256(lex8_in_range(_v, 0x09, 0x0D - 0x09), _mm256_cmpeq_epi8(_v, _mm256_set1_epi8(' ')));
+        _end = _mm256_or_si256(_end, _mm256_cmpeq_epi8(_v, _mm256_setzero_si256()));
+        _end = _mm256_or_si256(_end, _mm256_cmpeq_epi8(_v, _mm256_set1_epi8(';')));
+        for(uint32_t k = 0; k < sizeof(_special_char) - 1; k++) _end = _mm256_or_si256(_end, _mm256_cmpeq_epi8(_v, _special[k]));
+
+        _mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_end) << (_half * 32);
+        _lines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_lf) << (_half * 32);
+    }
+    _newline = _lines;
+    return _mask;
+}
+#endif
+
+#if defined(LEX8_SSE2)
+//Unsigned _lo <= x <= _lo + _range as a byte mask:
+static inline __m128i lex8_in_range(__m128i _v, uint8_t _lo, uint8_t _range){
+    __m128i _t = _mm_sub_epi8(_v, _mm_set1_epi8((char)_lo));
+    __m128i _r = _mm_set1_epi8((char)_range);
+    return _mm_cmpeq_epi8(_mm_max_epu8(_t, _r), _r);
+}
+
+static uint64_t lex8_block_sse2(uint8_t *_data, uint64_t &_newline){
+    static const char _special_char[] = READ8_SPECIAL_CHAR;
+    __m128i _special[sizeof(_special_char) - 1];
+    for(uint32_t k = 0; k < sizeof(_special_char) - 1; k++) _special[k] = _mm_set1_epi8(_special_char[k]);
+    uint64_t _mask = 0, _lines = 0;
+    for(uint32_t _quarter = 0; _quarter < 4; _quarter++){
+        __m128i *_p = (__m128i*)(_data + _quarter * 16);
+        __m128i _v = _mm_loadu_si128(_p);
+        __m128i _upper = lex8_in_range(_v, 'A', 'Z' - 'A');
+        _v = _mm_or_si128(_v, _mm_and_si128(_upper, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128(_p, _v);
+
+        __m128i _lf = _mm_or_si128(_mm_cmpeq_epi8(_v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(_v, _mm_set1_epi8('\r')));
+        __m128i _end = _mm_or_si128(lex8_in_range(_v, 0x09, 0x0D - 0x09), _mm_cmpeq_epi8(_v, _mm_set1_epi8(' ')));
+        _end = _mm_or_si128(_end, _mm_cmpeq_epi8(_v, _mm_setzero_si128()));
+        _end = _mm_or_si128(_end, _mm_cmpeq_epi8(_v, _mm_set1_epi8(';')));
+        for(uint32_t k = 0; k < sizeof(_special_char) - 1; k++) _end = _mm_or_si128(_end, _mm_cmpeq_epi8(_v, _special[k]));
+
+        _mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_end) << (_quarter * 16);
+        _lines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_lf) << (_quarter * 16);
+    }
+    _newline = _lines;
+    return _mask;
+}
+#endif
+
+uint64_t lex8::block_simd(uint8_t *_data, uint64_t &_newline){
+#if defined(LEX8_AVX2)
+    if(avx2()) return lex8_block_avx2(_data, _newline);
+#endif
+#if defined(LEX8_SSE2)
+    return lex8_block_sse2(_data, _newline);
+#else
+    return block_scalar(_data, LEX8_BLOCK, _newline);
+#endif
+}
+
+uint32_t lex8::lowest_bit(uint64_t _mask){
+#if defined(__GNUC__)
+    return __builtin_ctzll(_mask);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long _bit;
+    _BitScanForward64(&_bit, _mask);
+    return _bit;
+#else
+    uint32_t _bit = 0;
+    while(!(_mask & 1)){
+        _mask >>= 1;
+        _bit++;
+    }
+    return _bit;
+#endif
+}
+
+//Lexes the file over and over with the scalar and the SIMD blocks, next to a
+//plain copy of the same bytes as the bandwidth to compare with:
+int lex8::benchmark(string _filename){
+    ifstream _ifile(_filename.c_str(), ios::in | ios::binary);
+    if(!_ifile.is_open()){
+        cerr << "Could not open: " << _filename << endl;
+        return -1;
+    }
+    string _source((istreambuf_iterator<char>(_ifile)), istreambuf_iterator<char>());
+    _ifile.close();
+    if(_source.length() < 1){
+        cerr << "Empty file: " << _filename << endl;
+        return -1;
+    }
+    uint32_t _rounds = (LEX8_BENCH_BYTES / _source.length()) + 1;
+    double _mb = (double)_source.length() * _rounds / (1 << 20);
+
+    string _content = _source;
+    string _copy(_source.length(), '\0');
+    chrono::steady_clock::time_point _t = chrono::steady_clock::now();
+    for(uint32_t r = 0; r < _rounds; r++) memcpy(&_copy[0], _content.data(), _content.length());
+    double _copy_s = chrono::duration<double>(chrono::steady_clock::now() - _t).count();
+    if(_copy != _source) return -1;
+
+    vector<line_t> _results[2];
+    double _classify_s[2], _scan_s[2];
+    //The class masks are summed up and compared, which also keeps the
+    //compiler from dropping the classify loops:
+    uint64_t _sums[2];
+    for(uint32_t s = 0; s < 2; s++){
+        _content = _source;
+        uint64_t _sum = 0, _newline;
+        _t = chrono::steady_clock::now();
+        for(uint32_t r = 0; r < _rounds; r++){
+            for(size_t _block = 0; _block < _content.length(); _block += LEX8_BLOCK){
+                uint32_t _size = ((_content.length() - _block) < LEX8_BLOCK) ? (_content.length() - _block) : LEX8_BLOCK;
+                uint8_t *_data = (uint8_t*)&_content[_block];
+                _sum += (s && (_size == LEX8_BLOCK)) ? block_simd(_data, _newline) : block_scalar(_data, _size, _newline);
+            }
+        }
+        _classify_s[s] = chrono::duration<double>(chrono::steady_clock::now() - _t).count();
+        _sums[s] = _sum;
+
+        //Lowercasing again changes nothing, so every round works on the same buffer:
+        _t = chrono::steady_clock::now();
+        for(uint32_t r = 0; r < _rounds; r++){
+            _results[s].clear();
+            scan(_content, _results[s], s != 0);
+        }
+        _scan_s[s] = chrono::duration<double>(chrono::steady_clock::now() - _t).count();
+    }
+
+    cout << "Lexer benchmark: " << _filename << ", " << _source.length() << " bytes, " << _results[1].size() << " lines, " << _rounds << " rounds" << endl;
+    cout << "  copy:                " << (uint32_t)(_mb / _copy_s) << " MB/s" << endl;
+    cout << "  classify scalar:     " << (uint32_t)(_mb / _classify_s[0]) << " MB/s" << endl;
+    cout << "  classify " << simd_name() << ":" << string(11 - string(simd_name()).length(), ' ') << (uint32_t)(_mb / _classify_s[1]) << " MB/s" << endl;
+    cout << "  lex scalar:          " << (uint32_t)(_mb / _scan_s[0]) << " MB/s" << endl;
+    cout << "  lex " << simd_name() << ":" << string(16 - string(simd_name()).length(), ' ') << (uint32_t)(_mb / _scan_s[1]) << " MB/s" << endl;
+    cout << "  (lexing is bound by building the word strings of every line, not by the scan)" << endl;
+    if(_sums[0] != _sums[1]){
+        cerr << "Scalar and " << simd_name() << " classes differ" << endl;
+        return -1;
+    }
+    if(!(_results[0] == _results[1])){
+        cerr << "Scalar and " << simd_name() << " lexing differ" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Line Scanner
+ * Lowercases and splits source text into lines of words, 64 bytes at a time
+*/
+
+#ifndef LEX8_H_
+#define LEX8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "read8.h"
+
+#define LEX8_SPACE          0x01
+#define LEX8_SPECIAL        0x02
+#define LEX8_NEWLINE        0x04
+#define LEX8_COMMENT        0x08
+#define LEX8_BLOCK          64
+#define LEX8_BENCH_BYTES    (256u << 20)
+
+//Class bits and lowercase of every byte; the SIMD blocks compute the same
+//classes with compares, everything else looks them up here:
+class lex8_table_t{
+    public:
+        uint8_t     classes[256];
+        uint8_t     lower[256];
+
+        lex8_table_t();
+};
+
+class lex8{
+    public:
+        static const lex8_table_t &table();
+        static bool avx2();
+        static const char *simd_name();
+
+        static void scan(string &_content, vector<line_t> &_lines, bool _simd = true);
+        static void split(const string &_word, line_t &_code);
+        static uint64_t block_scalar(uint8_t *_data, uint32_t _length, uint64_t &_newline);
+        static uint64_t block_simd(uint8_t *_data, uint64_t &_newline);
+        static uint32_t lowest_bit(uint64_t _mask);
+
+        static int benchmark(string _filename);
+};
+
+#endif /* LEX8_H_ */
@@ -0,0 +1,310 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Relocatable Object Files and Linker
+ * Places module sections and resolves symbols across modules
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <map>
+#include "link8.h"
+#include "trace8.h"
+
+section_t::section_t(string _name, bool _absolute, uint16_t _base){
+    name = _name;
+    absolute = _absolute;
+    base = _base;
+}
+
+symbol_t::symbol_t(string _name, uint8_t _kind, int16_t _section, uint16_t _value){
+    name = _name;
+    kind = _kind;
+    section = _section;
+    value = _value;
+}
+
+reloc_t::reloc_t(uint16_t _section, uint16_t _offset, uint8_t _type, uint32_t _symbol, int32_t _addend){
+    section = _section;
+    offset = _offset;
+    type = _type;
+    symbol = _symbol;
+    addend = _addend;
+}
+
+//Writes _value plus the addend into the bytes at _addr:
+void reloc_t::apply(vector<uint8_t> &_image, uint32_t _addr, uint16_t _value) const{
+    if(type == reloc_word){
+        uint16_t _word = _value + addend;
+        _image[_addr] = _word & 0xFF;
+        _image[_addr + 1] = (_word >> 8) & 0xFF;
+    }
+    else if(type == reloc_lo8){
+        _image[_addr] = ((_value & 0xFF) + addend) & 0xFF;
+    }
+    else if(type == reloc_hi8){
+        _image[_addr] = (((_value >> 8) & 0xFF) + addend) & 0xFF;
+    }
+}
+
+//All values are stored little endian, strings with a one byte length:
+static void put_u8(string &_buf, uint8_t _value){ _buf += (char)_value; }
+static void put_u16(string &_buf, uint16_t _value){ put_u8(_buf, _value & 0xFF); put_u8(_buf, _value >> 8); }
+static void put_u32(string &_buf, uint32_t _value){ put_u16(_buf, _value & 0xFFFF); put_u16(_buf, _value >> 16); }
+static void put_str(string &_buf, string _str){ put_u8(_buf, _str.length()); _buf += _str.substr(0, 255); }
+
+static bool get_u8(const string &_buf, uint32_t &_pos, uint8_t &_value){
+    if(_pos + 1 > _buf.size()) return false;
+    _value = _buf[_pos++];
+    return true;
+}
+static bool get_u16(const string &_buf, uint32_t &_pos, uint16_t &_value){
+    uint8_t _lo, _hi;
+    if(!get_u8(_buf, _pos, _lo) || !get_u8(_buf, _pos, _hi)) return false;
+    _value = _lo | (_hi << 8);
+    return true;
+}
+static bool get_u32(const string &_buf, uint32_t &_pos, uint32_t &_value){
+    uint16_t _lo, _hi;
+    if(!get_u16(_buf, _pos, _lo) || !get_u16(_buf, _pos, _hi)) return false;
+    _value = _lo | ((uint32_t)_hi << 16);
+    return true;
+}
+static bool get_str(const string &_buf, uint32_t &_pos, string &_str){
+    uint8_t _len;
+    if(!get_u8(_buf, _pos, _len) || (_pos + _len > _buf.size())) return false;
+    _str = _buf.substr(_pos, _len);
+    _pos += _len;
+    return true;
+}
+
+int object_t::write(string _filename){
+    string _buf = OBJ8_MAGIC;
+    put_u16(_buf, OBJ8_VERSION);
+
+    put_u16(_buf, sections.size());
+    for(uint32_t i = 0; i < sections.size(); i++){
+        put_str(_buf, sections[i].name);
+        put_u8(_buf, sections[i].absolute ? 1 : 0);
+        put_u16(_buf, sections[i].base);
+        put_u32(_buf, sections[i].data.size());
+        _buf.append(sections[i].data.begin(), sections[i].data.end());
+    }
+    put_u32(_buf, symbols.size());
+    for(uint32_t i = 0; i < symbols.size(); i++){
+        put_str(_buf, symbols[i].name);
+        put_u8(_buf, symbols[i].kind);
+        put_u16(_buf, (uint16_t)symbols[i].section);
+        put_u16(_buf, symbols[i].value);
+    }
+    put_u32(_buf, relocs.size());
+    for(uint32_t i = 0; i < relocs.size(); i++){
+        put_u16(_buf, relocs[i].section);
+        put_u16(_buf, relocs[i].offset);
+        put_u8(_buf, relocs[i].type);
+        put_u32(_buf, relocs[i].symbol);
+        put_u32(_buf, (uint32_t)relocs[i].addend);
+    }
+
+    if(out8::write_file(_filename, _buf) < 0) return link8::error("Could not create/overwrite file: " + _filename);
+    return 0;
+}
+
+int object_t::read(string _filename){
+    filename = _filename;
+    ifstream _file(_filename.c_str(), ios::in | ios::binary);
+    if(!_file.is_open()) return link8::error("Could not open file: " + _filename);
+    string _buf((istreambuf_iterator<char>(_file)), istreambuf_iterator<char>());
+
+    uint32_t _pos = 4;
+    uint16_t _version, _count16;
+    uint32_t _count;
+    if((_buf.substr(0, 4) != OBJ8_MAGIC) || !get_u16(_buf, _pos, _version) || (_version != OBJ8_VERSION))
+        return link8::error("Not an asm8 object file: " + _filename);
+
+    if(!get_u16(_buf, _pos, _count16)) return link8::error("Truncated object file: " + _filename);
+    for(uint32_t i = 0; i < _count16; i++){
+        section_t _section;
+        uint8_t _absolute;
+        uint32_t _size;
+        if(!get_str(_buf, _pos, _section.name) || !get_u8(_buf, _pos, _absolute) || !get_u16(_buf, _pos, _section.base) ||
+           !get_u32(_buf, _pos, _size) || (_pos + _size > _buf.size())) return link8::error("Truncated object file: " + _filename);
+        _section.absolute = _absolute;
+        _section.data.assign(_buf.begin() + _pos, _buf.begin() + _pos + _size);
+        _pos += _size;
+        sections.push_back(_section);
+    }
+    if(!get_u32(_buf, _pos, _count)) return link8::error("Truncated object file: " + _filename);
+    for(uint32_t i = 0; i < _count; i++){
+        symbol_t _symbol;
+        uint16_t _section;
+        if(!get_str(_buf, _pos, _symbol.name) || !get_u8(_buf, _pos, _symbol.kind) || !get_u16(_buf, _pos, _section) ||
+           !get_u16(_buf, _pos, _symbol.value)) return link8::error("Truncated object file: " + _filename);
+        _symbol.section = (int16_t)_section;
+        symbols.push_back(_symbol);
+    }
+    if(!get_u32(_buf, _pos, _count)) return link8::error("Truncated object file: " + _filename);
+    for(uint32_t i = 0; i < _count; i++){
+        reloc_t _reloc;
+        uint32_t _addend;
+        if(!get_u16(_buf, _pos, _reloc.section) || !get_u16(_buf, _pos, _reloc.offset) || !get_u8(_buf, _pos, _reloc.type) ||
+           !get_u32(_buf, _pos, _reloc.symbol) || !get_u32(_buf, _pos, _addend)) return link8::error("Truncated object file: " + _filename);
+        _reloc.addend = (int32_t)_addend;
+        if((_reloc.section >= sections.size()) || (_reloc.symbol >= symbols.size()) ||
+           (_reloc.offset + ((_reloc.type == reloc_t::reloc_word) ? 2u : 1u) > sections[_reloc.section].data.size()))
+            return link8::error("Invalid relocation in object file: " + _filename);
+        relocs.push_back(_reloc);
+    }
+    return 0;
+}
+
+link8::link8(){
+    objects.clear();
+    image.clear();
+    used.assign(LINK8_MEMORY_SIZE, false);
+    base = 0;
+    fill = 0xFF;
+    format = out8::format_bin;
+}
+
+int link8::link(vector<string> _in, string _out){
+    trace_span_t _span("link", "link", _out);
+    for(uint32_t i = 0; i < _in.size(); i++){
+        trace_span_t _read("link", "read object", _in[i]);
+        object_t _object;
+        if(_object.read(_in[i]) != 0) return -1;
+        objects.push_back(_object);
+    }
+
+    trace_span_t _place("link", "place and relocate");
+    if(place_sections() != 0) return -1;
+    if(resolve_symbols() != 0) return -1;
+    if(apply_relocs() != 0) return -1;
+    _place.end();
+
+    trace_span_t _write("write", "write output", _out);
+    int _written = out8::write(_out, format, image, out8::get_segments(used, image.size()));
+    if(_written < 0) return error("Could not create/overwrite file: " + _out);
+
+    cout << "\nFiles successfully linked\n" << ((_written == 0) ? "File saved to: " : "File unchanged: ") << _out << endl;
+    return 0;
+}
+
+bool link8::place_at(uint32_t _addr, uint32_t _size){
+    if(_addr + _size > LINK8_MEMORY_SIZE) return false;
+    for(uint32_t i = _addr; i < _addr + _size; i++) if(used[i]) return false;
+    for(uint32_t i = _addr; i < _addr + _size; i++) used[i] = true;
+    return true;
+}
+
+//Start of the smallest free gap in _start.._end (inclusive) that holds
+//_size bytes, the lowest one of equal gaps; -1 if none does:
+int32_t link8::find_gap(uint32_t _size, uint32_t _start, uint32_t _end){
+    int32_t _best = -1;
+    uint32_t _best_size = 0;
+    if(_end >= LINK8_MEMORY_SIZE) _end = LINK8_MEMORY_SIZE - 1;
+    uint32_t _addr = _start;
+    while(_addr <= _end){
+        if(used[_addr]){
+            _addr++;
+            continue;
+        }
+        uint32_t _gap = _addr;
+        while((_addr <= _end) && !used[_addr]) _addr++;
+        if(((_addr - _gap) >= _size) && ((_best < 0) || ((_addr - _gap) < _best_size))){
+            _best = _gap;
+            _best_size = _addr - _gap;
+        }
+    }
+    return _best;
+}
+
+//Absolute sections keep their address, relocatable ones go into the first
+//gap at or above the link base that is big enough, in command line order:
+int link8::place_sections(){
+    char _buf[128];
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].sections.size(); j++){
+            section_t &_section = objects[i].sections[j];
+            if(!_section.absolute) continue;
+            if(!place_at(_section.base, _section.data.size())){
+                sprintf(_buf, "Section %s of %s overlaps at 0x%04X", _section.name.c_str(), objects[i].filename.c_str(), _section.base);
+                return error(_buf);
+            }
+        }
+    }
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].sections.size(); j++){
+            section_t &_section = objects[i].sections[j];
+            if(_section.absolute) continue;
+            uint32_t _addr = base;
+            while((_addr + _section.data.size() <= LINK8_MEMORY_SIZE) && !place_at(_addr, _section.data.size())) _addr++;
+            if(_addr + _section.data.size() > LINK8_MEMORY_SIZE) return error("No room for section " + _section.name + " of " + objects[i].filename);
+            _section.base = _addr;
+        }
+    }
+
+    cout << "--------------------------------" << endl;
+    cout << "Sections:" << endl;
+    uint32_t _end = 0;
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].sections.size(); j++){
+            section_t &_section = objects[i].sections[j];
+            if(_section.data.size() < 1) continue;
+            sprintf(_buf, "\t0x%04X - 0x%04X\t%s", _section.base, (uint32_t)(_section.base + _section.data.size() - 1), _section.absolute ? "abs" : "rel");
+            cout << _buf << "\t" << objects[i].filename << "(" << _section.name << ")" << endl;
+            if(_section.base + _section.data.size() > _end) _end = _section.base + _section.data.size();
+        }
+    }
+    cout << "--------------------------------" << endl;
+
+    image.assign(_end, fill);
+    for(uint32_t i = 0; i < objects.size(); i++)
+        for(uint32_t j = 0; j < objects[i].sections.size(); j++)
+            for(uint32_t k = 0; k < objects[i].sections[j].data.size(); k++)
+                image[objects[i].sections[j].base + k] = objects[i].sections[j].data[k];
+    return 0;
+}
+
+//Turn every symbol value into a final address; externs take the address of
+//the global symbol with the same name:
+int link8::resolve_symbols(){
+    map<string, uint16_t> _globals;
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].symbols.size(); j++){
+            symbol_t &_symbol = objects[i].symbols[j];
+            if(_symbol.kind == symbol_t::symbol_extern) continue;
+            if(_symbol.section >= 0) _symbol.value += objects[i].sections[_symbol.section].base;
+            if(_symbol.kind != symbol_t::symbol_global) continue;
+            if(_globals.find(_symbol.name) != _globals.end()) return error("Symbol defined in more than one module: " + _symbol.name + " (" + objects[i].filename + ")");
+            _globals[_symbol.name] = _symbol.value;
+        }
+    }
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].symbols.size(); j++){
+            symbol_t &_symbol = objects[i].symbols[j];
+            if(_symbol.kind != symbol_t::symbol_extern) continue;
+            if(_globals.find(_symbol.name) == _globals.end()) return error("Unresolved external symbol: " + _symbol.name + " (" + objects[i].filename + ")");
+            _symbol.value = _globals[_symbol.name];
+        }
+    }
+    return 0;
+}
+
+int link8::apply_relocs(){
+    for(uint32_t i = 0; i < objects.size(); i++){
+        for(uint32_t j = 0; j < objects[i].relocs.size(); j++){
+            reloc_t &_reloc = objects[i].relocs[j];
+            uint32_t _addr = objects[i].sections[_reloc.section].base + _reloc.offset;
+            _reloc.apply(image, _addr, objects[i].symbols[_reloc.symbol].value);
+        }
+    }
+    return 0;
+}
+
+int link8::error(string _str){
+    cerr << "Error: " << _str << endl;
+    return -1;
+}
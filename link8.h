@@ -0,0 +1,89 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Relocatable Object Files and Linker
+ * Places module sections and resolves symbols across modules
+*/
+
+#ifndef LINK8_H_
+#define LINK8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "out8.h"
+
+#define OBJ8_MAGIC          "A8OB"
+#define OBJ8_VERSION        1
+#define LINK8_MEMORY_SIZE   0x4000
+
+class section_t{
+    public:
+        string          name;
+        bool            absolute;
+        uint16_t        base;
+        vector<uint8_t> data;
+
+        section_t(string _name = "", bool _absolute = false, uint16_t _base = 0);
+};
+
+class symbol_t{
+    public:
+        enum symbol_kind {symbol_local = 0, symbol_global = 1, symbol_extern = 2};
+
+        string      name;
+        uint8_t     kind;
+        int16_t     section;
+        uint16_t    value;
+
+        symbol_t(string _name = "", uint8_t _kind = symbol_local, int16_t _section = -1, uint16_t _value = 0);
+};
+
+class reloc_t{
+    public:
+        enum reloc_type {reloc_word = 0, reloc_lo8 = 1, reloc_hi8 = 2};
+
+        uint16_t    section;
+        uint16_t    offset;
+        uint8_t     type;
+        uint32_t    symbol;
+        int32_t     addend;
+
+        reloc_t(uint16_t _section = 0, uint16_t _offset = 0, uint8_t _type = reloc_word, uint32_t _symbol = 0, int32_t _addend = 0);
+        void apply(vector<uint8_t> &_image, uint32_t _addr, uint16_t _value) const;
+};
+
+class object_t{
+    public:
+        string              filename;
+        vector<section_t>   sections;
+        vector<symbol_t>    symbols;
+        vector<reloc_t>     relocs;
+
+        int write(string _filename);
+        int read(string _filename);
+};
+
+class link8{
+    public:
+        vector<object_t>    objects;
+        vector<uint8_t>     image;
+        vector<bool>        used;
+        uint32_t            base;
+        uint8_t             fill;
+        out8::format_t      format;
+
+        link8();
+        int link(vector<string> _in, string _out);
+        int place_sections();
+        int resolve_symbols();
+        int apply_relocs();
+        bool place_at(uint32_t _addr, uint32_t _size);
+        int32_t find_gap(uint32_t _size, uint32_t _start, uint32_t _end);
+
+        static int error(string _str);
+};
+
+#endif /* LINK8_H_ */
@@ -9,8 +9,220 @@ using namespace std;
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstdlib>
+#include <chrono>
 #include "main.h"
 #include "asm8.h"
+#include "emu8.h"
+#include "link8.h"
+#include "map8.h"
+#include "watch8.h"
+#include "cache8.h"
+#include "xref8.h"
+#include "lex8.h"
+#include "dis8.h"
+#include "trace8.h"
+
+int run_image(vector<uint8_t> _image, asm8 *_asm8){
+    trace_span_t _span("run", "run");
+    emu8 _emu;
+    _emu.load(_image);
+    _emu.profile = (opt_profile != "");
+    
+    //Configure the port stubs, "--in 3=0x41,0x42" feeds inp 3:
+    for(uint32_t i = 0; i < opt_in.size(); i++){
+        size_t _eq = opt_in[i].find('=');
+        if(_eq == string::npos){ cerr << "Invalid --in option: " << opt_in[i] << endl; return -1;}
+        uint32_t _port = strtoul(opt_in[i].substr(0, _eq).c_str(), nullptr, 0);
+        vector<uint8_t> _data;
+        string _values = opt_in[i].substr(_eq + 1);
+        size_t _cursor = 0;
+        while(_cursor < _values.length()){
+            size_t _comma = _values.find(',', _cursor);
+            if(_comma == string::npos) _comma = _values.length();
+            _data.push_back(strtoul(_values.substr(_cursor, _comma - _cursor).c_str(), nullptr, 0));
+            _cursor = _comma + 1;
+        }
+        _emu.set_input(_port, _data);
+    }
+    for(uint32_t i = 0; i < opt_echo.size(); i++) if(opt_echo[i] < EMU8_OUTPUT_PORTS) _emu.out_echo[opt_echo[i]] = true;
+    
+    emu8::stop_reason _stop = _emu.run(opt_cycles);
+    _span.end();
+    _emu.print_state();
+    
+    //A binary map translates the stop address back into the source; the PC
+    //already points behind a hlt:
+    if(opt_map != ""){
+        map8 _map;
+        string _file, _label;
+        uint32_t _line, _offset;
+        uint16_t _pc = (_stop == emu8::stop_halt) ? ((_emu.get_pc() - 1) & EMU8_ADDRESS_MASK) : _emu.get_pc();
+        if(!_map.open(opt_map)) cerr << "Could not open map file: " << opt_map << endl;
+        else if(_map.find_line(_pc, _file, _line)){
+            cout << "Stopped in " << _file << ", Line " << _line;
+            if(_map.find_symbol(_pc, _label, _offset)) cout << " (" << _label << " + " << _offset << ")";
+            cout << endl;
+        }
+    }
+    
+    //Profiles are mapped back to the source, so they need the assembler's line info:
+    if(_emu.profile){
+        if(_asm8 == nullptr) cerr << "--profile requires an assembly source, not a .bin image" << endl;
+        else if(_asm8->write_profile(opt_profile, _emu.prof_count, _emu.prof_cycles) == 0 && opt_profile != "-")
+            cout << "Profile saved to: " << opt_profile << endl;
+    }
+    
+    if(_stop == emu8::stop_halt)            return 0;
+    else if(_stop == emu8::stop_cycle_budget) return 1;
+    else                                    return 2;
+}
+
+void configure(asm8 &_asm8){
+    _asm8.peephole = opt_peephole;
+    _asm8.object_mode = opt_object;
+    _asm8.streaming = opt_stream;
+    _asm8.format = opt_format;
+    _asm8.org_fill = opt_fill;
+    _asm8.map_file = opt_map_text;
+    _asm8.map_binary_file = opt_map_binary;
+    _asm8.size_report_file = opt_size_report;
+    _asm8.max_errors = opt_max_errors;
+    _asm8.xref_file = opt_xref;
+}
+
+//Looks a symbol up by name, or by a "file:line" that uses it, in an index
+//written by --xref:
+int xref_find(string _index, string _query){
+    xref8 _xref;
+    if(!_xref.open(_index)){ cerr << "Could not open cross-reference index: " << _index << endl; return -1;}
+    int32_t _symbol = _xref.find(_query);
+    size_t _colon = _query.rfind(':');
+    if((_symbol < 0) && (_colon != string::npos) && (_colon + 1 < _query.length()) && isdigit(_query[_colon + 1]))
+        _symbol = _xref.find_at(_query.substr(0, _colon), strtoul(_query.substr(_colon + 1).c_str(), nullptr, 10));
+    if(_symbol < 0){ cerr << "Not found: " << _query << endl; return 1;}
+    
+    const char *_kinds[3] = {"label", "define", "macro"};
+    string _file;
+    uint32_t _line;
+    _xref.get_definition(_symbol, _file, _line);
+    cout << _xref.get_name(_symbol) << " (" << _kinds[_xref.get_kind(_symbol) % 3] << ") defined in " << _file << ", Line " << _line << endl;
+    for(uint32_t i = 0; i < _xref.get_use_count(_symbol); i++){
+        _xref.get_use(_symbol, i, _file, _line);
+        cout << "\tused in " << _file << ", Line " << _line << endl;
+    }
+    return 0;
+}
+
+//Writes the source of a flat binary, named with the labels of a binary map:
+int disasm_image(string _in, string _out){
+    ifstream _file(_in.c_str(), ios::in | ios::binary);
+    if(!_file.is_open()){ cerr << "Could not open file: " << _in << endl; return -1;}
+    vector<uint8_t> _image((istreambuf_iterator<char>(_file)), istreambuf_iterator<char>());
+    
+    dis8 _dis8;
+    if((opt_map != "") && !_dis8.load_map(opt_map)) cerr << "Could not open map: " << opt_map << ", disassembling without labels" << endl;
+    string _source = _dis8.disassemble(_image);
+    if((_out == "") || (_out == "-")){
+        cout << _source;
+        return 0;
+    }
+    int _written = out8::write_file(_out, _source);
+    if(_written < 0){ cerr << "Could not create file: " << _out << endl; return -1;}
+    cout << ((_written == 0) ? "File saved to: " : "File unchanged: ") << _out << endl;
+    return 0;
+}
+
+//Assembles every file, disassembles the image with the labels of that run
+//and assembles the result again from memory; both images have to match:
+int roundtrip(const vector<string> &_files){
+    chrono::steady_clock::time_point _start = chrono::steady_clock::now();
+    uint32_t _failed = 0;
+    uint64_t _bytes = 0;
+    for(uint32_t i = 0; i < _files.size(); i++){
+        asm8 _first;
+        _first.peephole = opt_peephole;
+        _first.org_fill = opt_fill;
+        _first.max_errors = opt_max_errors;
+        if(_first.assemble(_files[i], "") != 0){
+            cerr << "FAILED " << _files[i] << ": does not assemble" << endl;
+            _failed++;
+            continue;
+        }
+        
+        dis8 _dis8;
+        for(uint32_t j = 0; j < _first.label_list.size(); j++)
+            if(!_first.label_list[j].is_extern) _dis8.add_label(_first.label_list[j].address, _first.label_list[j].name);
+        string _source = _dis8.disassemble(_first.binary_out);
+        
+        lexed_file_t *_lexed = new lexed_file_t(read8::convert_slash(_files[i] + ".dis"));
+        _lexed->opened = true;
+        lex8::scan(_source, _lexed->lines);
+        asm8 _second;
+        _second.org_fill = opt_fill;
+        _second.max_errors = opt_max_errors;
+        _second.reader.files[_lexed->filename] = shared_ptr<const lexed_file_t>(_lexed);
+        if(_second.assemble(_lexed->filename, "") != 0){
+            cerr << "FAILED " << _files[i] << ": the disassembly does not assemble" << endl;
+            _failed++;
+            continue;
+        }
+        
+        const vector<uint8_t> &_a = _first.binary_out, &_b = _second.binary_out;
+        uint32_t _diff = 0;
+        while((_diff < _a.size()) && (_diff < _b.size()) && (_a[_diff] == _b[_diff])) _diff++;
+        if((_diff < _a.size()) || (_diff < _b.size())){
+            cerr << "FAILED " << _files[i] << ": images differ at " << dis8::hex(_diff, 4) << endl;
+            _failed++;
+            continue;
+        }
+        _bytes += _a.size();
+    }
+    double _ms = chrono::duration<double, milli>(chrono::steady_clock::now() - _start).count();
+    cout << (_files.size() - _failed) << " of " << _files.size() << " round trips ok, " << _bytes << " bytes in " << (uint32_t)_ms << " ms" << endl;
+    return (_failed > 0) ? 1 : 0;
+}
+
+//Everything besides the sources that changes the output file:
+string cache_options(){
+    return "format " + to_string(opt_format) + "\nfill " + to_string(opt_fill) + "\npeephole " + to_string(opt_peephole) + "\nobject " + to_string(opt_object) + "\n";
+}
+
+//Assembles again whenever one of the files the last run read changes. The
+//lexed files stay cached between runs, only the changed ones are read again:
+int watch_loop(){
+    watch8 _watch;
+    if(!_watch.init()){ cerr << "--watch needs inotify (Linux)" << endl; return -1;}
+    map<string, shared_ptr<const lexed_file_t>> _cache;
+    while(true){
+        chrono::steady_clock::time_point _start = chrono::steady_clock::now();
+        vector<string> _files;
+        {
+            asm8 _asm8;
+            configure(_asm8);
+            _asm8.reader.files = _cache;
+            _asm8.assemble(opt_i, opt_o);
+            _cache = _asm8.reader.files;
+        }
+        //Every run replaces the trace of the one before:
+        if(opt_trace != ""){
+            trace8::write(opt_trace);
+            trace8::start();
+        }
+        for(map<string, shared_ptr<const lexed_file_t>>::iterator _it = _cache.begin(); _it != _cache.end(); _it++) _files.push_back(_it->first);
+        if(_files.size() < 1) _files.push_back(read8::convert_slash(opt_i));
+        double _ms = chrono::duration<double, milli>(chrono::steady_clock::now() - _start).count();
+        cout << "Finished in " << _ms << " ms, watching " << _files.size() << " file(s)..." << endl;
+        
+        _watch.watch(_files);
+        vector<string> _changed = _watch.wait();
+        if(_changed.size() < 1) return -1;
+        for(uint32_t i = 0; i < _changed.size(); i++){
+            cout << "\nChanged: " << _changed[i] << endl;
+            _cache.erase(_changed[i]);
+        }
+    }
+}
 
 int main(int argc, char** argv){
     cout << info << endl;
@@ -18,19 +230,123 @@ int main(int argc, char** argv){
     
     //Clear option fields:
     opt_i = ""; opt_o = "";
+    opt_run = false; opt_cycles = 10000000;
+    opt_peephole = false;
+    opt_object = false; opt_link = false; opt_link_base = 0;
+    opt_stream = false;
+    opt_format = out8::format_bin; opt_fill = 0xFF;
+    opt_files.clear();
+    opt_in.clear(); opt_echo.clear();
+    opt_profile = "";
+    opt_map_text = ""; opt_map_binary = ""; opt_map = "";
+    opt_size_report = "";
+    opt_max_errors = 20;
+    opt_watch = false;
+    opt_cache = "";
+    opt_xref = "";
+    opt_disasm = false; opt_roundtrip = false;
+    opt_trace = "";
     //Parse options:
     if(string(argv[1]) == string("-h")) {cout << help << endl; return 0;}
     if(argc == 2) opt_i = argv[1];
     else{
         for(int i = 1; i < argc; i++){
-            if(argv[i] == string("-i"))         opt_i = argv[i + 1];
-            else if(argv[i] == string("-o"))    opt_o = argv[i + 1];
+            if(argv[i] == string("-i") && (i + 1 < argc))               opt_i = argv[++i];
+            else if(argv[i] == string("-o") && (i + 1 < argc))          opt_o = argv[++i];
+            else if(argv[i] == string("-O"))                            opt_peephole = true;
+            else if(argv[i] == string("-c"))                            opt_object = true;
+            else if(argv[i] == string("-f") && (i + 1 < argc)){
+                if(!out8::parse_format(argv[++i], opt_format)){ cerr << "Unknown output format: " << argv[i] << endl; return -1;}
+            }
+            else if(argv[i] == string("--fill") && (i + 1 < argc))      opt_fill = strtoul(argv[++i], nullptr, 0);
+            else if(argv[i] == string("--stream"))                      opt_stream = true;
+            else if(argv[i] == string("--link"))                        opt_link = true;
+            else if(argv[i] == string("--link-base") && (i + 1 < argc)) opt_link_base = strtoul(argv[++i], nullptr, 0);
+            else if(argv[i] == string("--run"))                         opt_run = true;
+            else if(argv[i] == string("--cycles") && (i + 1 < argc))    opt_cycles = strtoull(argv[++i], nullptr, 0);
+            else if(argv[i] == string("--in") && (i + 1 < argc))        opt_in.push_back(argv[++i]);
+            else if(argv[i] == string("--echo") && (i + 1 < argc))      opt_echo.push_back(strtoul(argv[++i], nullptr, 0));
+            else if(argv[i] == string("--profile") && (i + 1 < argc))   opt_profile = argv[++i];
+            else if(argv[i] == string("-m") && (i + 1 < argc))          opt_map_text = argv[++i];
+            else if(argv[i] == string("-M") && (i + 1 < argc))          opt_map_binary = argv[++i];
+            else if(argv[i] == string("--map") && (i + 1 < argc))       opt_map = argv[++i];
+            else if(argv[i] == string("--size-report") && (i + 1 < argc)) opt_size_report = argv[++i];
+            else if(argv[i] == string("--max-errors") && (i + 1 < argc)) opt_max_errors = strtoul(argv[++i], nullptr, 0);
+            else if(argv[i] == string("--watch"))                       opt_watch = true;
+            else if(argv[i] == string("--cache") && (i + 1 < argc))     opt_cache = argv[++i];
+            else if(argv[i] == string("--xref") && (i + 1 < argc))      opt_xref = argv[++i];
+            else if(argv[i] == string("--xref-find") && (i + 2 < argc)) return xref_find(argv[i + 1], argv[i + 2]);
+            else if(argv[i] == string("--trace") && (i + 1 < argc))     opt_trace = argv[++i];
+            else if(argv[i] == string("--disasm"))                      opt_disasm = true;
+            else if(argv[i] == string("--roundtrip"))                   opt_roundtrip = true;
+            else if(argv[i] == string("--bench-lex") && (i + 1 < argc))  return lex8::benchmark(argv[i + 1]);
+            else if(argv[i][0] != '-')                                  opt_files.push_back(argv[i]);
         }
+        if((opt_i == "") && (opt_files.size() > 0)) opt_i = opt_files[0];
+    }
+    
+    //Written on every way out of main from here on:
+    trace_session_t _trace(opt_trace);
+    
+    //Link step: places the sections of all objects and resolves their symbols:
+    if(opt_link){
+        if(opt_o == "") opt_o = "a" + out8::extension(opt_format);
+        link8 _link8;
+        _link8.base = opt_link_base;
+        _link8.fill = opt_fill;
+        _link8.format = opt_format;
+        int _result = _link8.link(opt_files, opt_o);
+        if((_result != 0) || !opt_run) return _result;
+        return run_image(_link8.image, nullptr);
     }
     
-    //If -o was omitted, then default is "ifile_name.bin":
-    if(opt_o == "") {opt_o = (opt_i.rfind('.') == string::npos) ? opt_i + "" : opt_i.substr(0, opt_i.rfind('.')) + ".bin";}
+    if(opt_disasm) return disasm_image(opt_i, opt_o);
+    if(opt_roundtrip) return roundtrip(opt_files);
+    
+    //A flat binary is run as it is, without assembling:
+    if(opt_run && (opt_i.length() > 4) && (opt_i.substr(opt_i.length() - 4) == ".bin")){
+        ifstream _file(opt_i.c_str(), ios::in | ios::binary);
+        if(!_file.is_open()){ cerr << "Could not open file: " << opt_i << endl; return -1;}
+        vector<uint8_t> _image((istreambuf_iterator<char>(_file)), istreambuf_iterator<char>());
+        return run_image(_image, nullptr);
+    }
+    
+    //If -o was omitted, then default is "ifile_name.bin" (or .hex/.s19 for -f):
+    if(opt_o == "") {opt_o = (opt_i.rfind('.') == string::npos) ? opt_i + "" : opt_i.substr(0, opt_i.rfind('.')) + (opt_object ? ".o8" : out8::extension(opt_format));}
 
-    return asm8().assemble(opt_i, opt_o);
+    //The optimizer, object output and the profile all need the whole expanded program:
+    if(opt_stream && (opt_peephole || opt_object || (opt_profile != ""))){
+        cerr << "--stream can not be combined with -O, -c or --profile, assembling normally" << endl;
+        opt_stream = false;
+    }
+    
+    //The cache only stands in for the output file, not for the other results of a run:
+    if((opt_cache != "") && (opt_run || opt_watch || (opt_profile != "") || (opt_map_text != "") || (opt_map_binary != "") || (opt_size_report != "") || (opt_xref != ""))){
+        cerr << "--cache can not be combined with --run, --watch, --profile, -m, -M, --size-report or --xref, assembling without it" << endl;
+        opt_cache = "";
+    }
+    if(opt_watch) return watch_loop();
+    
+    cache8 _cache(opt_cache, cache_options());
+    if(opt_cache != ""){
+        int _fetched = _cache.fetch(opt_i, opt_o);
+        if(_fetched >= 0){
+            cout << "Cache hit\n" << ((_fetched == 0) ? "File saved to: " : "File unchanged: ") << opt_o << endl;
+            return 0;
+        }
+    }
+    
+    asm8 _asm8;
+    configure(_asm8);
+    int _result = _asm8.assemble(opt_i, opt_o);
+    if((_result == 0) && (opt_cache != "")){
+        vector<string> _files;
+        for(map<string, shared_ptr<const lexed_file_t>>::iterator _it = _asm8.reader.files.begin(); _it != _asm8.reader.files.end(); _it++)
+            if(_it->second->opened) _files.push_back(_it->first);
+        _cache.store(opt_i, opt_o, _files);
+    }
+    if(opt_profile != "") opt_run = true;
+    if((_result != 0) || !opt_run || opt_object) return _result;
+    
+    return run_image(_asm8.binary_out, &_asm8);
 }
-
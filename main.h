@@ -11,6 +11,9 @@ using namespace std;
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <stdint.h>
+#include "asm8.h"
 
 int error(string _str);
 
@@ -21,10 +24,64 @@ const char info[] = "ASM8 Intel 8008 Assembler, by Yasin\n"
 const char help[] = "  -h show this help\n"
                     "  -i specify input file\n"
                     "  -o specify output file\n"
+                    "  -O run the peephole optimizer on the expanded code\n"
+                    "  -f <bin|hex|srec> output format, hex and srec only carry the populated address ranges\n"
+                    "  --fill <byte> value for the gaps left by .org (default 0xFF)\n"
+                    "  -m <file> write a text symbol map: symbols, macro expansion sites and the line table\n"
+                    "  -M <file> write the same map in the binary format\n"
+                    "  --size-report <file> print the bytes per file, label span and macro and write them as JSON (- for stdout)\n"
+                    "  --max-errors <n> stop after n errors, 0 for no limit (default 20)\n"
+                    "  --watch assemble again whenever one of the source files changes\n"
+                    "  --xref <file> write a cross-reference index of all definitions and uses\n"
+                    "  --xref-find <file> <name|file:line> show the definition and uses of a symbol from an index\n"
+                    "  --bench-lex <file> measure the lexer throughput on a source file, scalar against SIMD\n"
+                    "  --disasm disassemble a .bin input (to -o, or stdout), with the labels of --map if given\n"
+                    "  --roundtrip <a.asm> <b.asm> ... assemble, disassemble and assemble again, and compare the images\n"
+                    "  --trace <file> write a timeline of file loads, passes, includes, macro expansion and output (Chrome trace JSON, for Perfetto)\n"
+                    "  --cache <dir> reuse the output of an earlier build with the same sources and options\n"
+                    "  -c assemble into a relocatable object file (default \"in.o8\")\n"
+                    "  --stream encode lines as they are expanded, without keeping the whole program\n"
+                    "  --link <a.o8> <b.o8> ... link object files into a binary (default \"a.bin\")\n"
+                    "  --link-base <addr> lowest address for relocatable sections\n"
+                    "  --run run the assembled image (or a .bin input) in the built-in emulator\n"
+                    "  --cycles <n> cycle budget for --run (default 10000000)\n"
+                    "  --in <port>=<b0>,<b1>,... bytes returned by inp <port>, the last one repeats\n"
+                    "  --echo <port> print bytes written by out <port> as characters\n"
+                    "  --map <file> binary map used to show where --run stopped in the source\n"
+                    "  --profile <file> write hot spots, coverage and an annotated listing of the run (- for stdout)\n"
                     "  use \"\" if path contains spaces";
 
 string opt_i, opt_o;
+bool opt_run;
+bool opt_peephole;
+bool opt_object;
+bool opt_stream;
+out8::format_t opt_format;
+uint8_t opt_fill;
+bool opt_link;
+uint32_t opt_link_base;
+vector<string> opt_files;
+uint64_t opt_cycles;
+vector<string> opt_in;
+vector<uint32_t> opt_echo;
+string opt_profile;
+string opt_map_text, opt_map_binary, opt_map;
+string opt_size_report;
+uint32_t opt_max_errors;
+bool opt_watch;
+string opt_cache;
+string opt_xref;
+bool opt_disasm;
+bool opt_roundtrip;
+string opt_trace;
 
+int run_image(vector<uint8_t> _image, asm8 *_asm8);
+void configure(asm8 &_asm8);
+string cache_options();
+int xref_find(string _index, string _query);
+int disasm_image(string _in, string _out);
+int roundtrip(const vector<string> &_files);
+int watch_loop();
 int main(int argc, char** argv);
 
 #endif
@@ -0,0 +1,256 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Symbol Maps
+ * Writes symbols, macro expansion sites and the address to source line table,
+ * and looks addresses up in a memory mapped binary map
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include "map8.h"
+#include "out8.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAP8_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+map_symbol_t::map_symbol_t(string _name, uint32_t _value, uint8_t _kind, uint16_t _file_id, uint32_t _line){
+    name = _name;
+    value = _value;
+    kind = _kind;
+    file_id = _file_id;
+    line = _line;
+}
+
+map_line_t::map_line_t(uint32_t _address, uint32_t _size, string _name, uint16_t _file_id, uint32_t _line){
+    address = _address;
+    size = _size;
+    name = _name;
+    file_id = _file_id;
+    line = _line;
+}
+
+//Labels come first, then defines, each by value; lines and expansions by address:
+void map8::sort(){
+    std::stable_sort(symbols.begin(), symbols.end(), [](const map_symbol_t &_a, const map_symbol_t &_b){
+        return (_a.kind != _b.kind) ? (_a.kind < _b.kind) : (_a.value < _b.value);
+    });
+    std::stable_sort(lines.begin(), lines.end(), [](const map_line_t &_a, const map_line_t &_b){ return _a.address < _b.address; });
+    std::stable_sort(expansions.begin(), expansions.end(), [](const map_line_t &_a, const map_line_t &_b){ return _a.address < _b.address; });
+}
+
+static string format_source(const vector<string> &_files, uint16_t _file_id, uint32_t _line){
+    return ((_file_id < _files.size()) ? _files[_file_id] : string("?")) + ":" + to_string(_line);
+}
+
+int map8::write_text(string _filename){
+    char _buf[32];
+    string _out = "; asm8 symbol map\n[symbols]\n";
+    for(uint32_t i = 0; i < symbols.size(); i++){
+        sprintf(_buf, "0x%04X\t%s\t", symbols[i].value, (symbols[i].kind == map_symbol_t::symbol_label) ? "label " : "define");
+        _out += _buf + symbols[i].name + "\t" + format_source(files, symbols[i].file_id, symbols[i].line) + "\n";
+    }
+    _out += "[expansions]\n";
+    for(uint32_t i = 0; i < expansions.size(); i++){
+        sprintf(_buf, "0x%04X\t", expansions[i].address);
+        _out += _buf + expansions[i].name + "\t" + format_source(files, expansions[i].file_id, expansions[i].line) + "\n";
+    }
+    _out += "[lines]\n";
+    for(uint32_t i = 0; i < lines.size(); i++){
+        sprintf(_buf, "0x%04X\t%u\t", lines[i].address, lines[i].size);
+        _out += _buf + format_source(files, lines[i].file_id, lines[i].line) + "\n";
+    }
+
+    return (out8::write_file(_filename, _out) < 0) ? -1 : 0;
+}
+
+static void put_u16(string &_buf, uint16_t _value){ _buf += (char)(_value & 0xFF); _buf += (char)(_value >> 8); }
+static void put_u32(string &_buf, uint32_t _value){ put_u16(_buf, _value & 0xFFFF); put_u16(_buf, _value >> 16); }
+
+int map8::write_binary(string _filename){
+    //Equal names share one string:
+    string _strings;
+    map<string, uint32_t> _string_offsets;
+    auto _add_string = [&](const string &_str) -> uint32_t{
+        map<string, uint32_t>::iterator _it = _string_offsets.find(_str);
+        if(_it != _string_offsets.end()) return _it->second;
+        uint32_t _offset = _strings.size();
+        _strings += _str;
+        _strings += '\0';
+        _string_offsets[_str] = _offset;
+        return _offset;
+    };
+
+    string _buf = MAP8_MAGIC;
+    put_u16(_buf, MAP8_VERSION);
+    put_u16(_buf, 0);
+    put_u32(_buf, files.size());
+    put_u32(_buf, symbols.size());
+    put_u32(_buf, lines.size());
+    put_u32(_buf, expansions.size());
+    string _records;
+    for(uint32_t i = 0; i < files.size(); i++) put_u32(_records, _add_string(files[i]));
+    for(uint32_t i = 0; i < symbols.size(); i++){
+        put_u32(_records, _add_string(symbols[i].name));
+        put_u32(_records, symbols[i].value);
+        _records += (char)symbols[i].kind;
+        _records += (char)0;
+        put_u16(_records, symbols[i].file_id);
+        put_u32(_records, symbols[i].line);
+    }
+    for(uint32_t i = 0; i < lines.size(); i++){
+        put_u32(_records, lines[i].address);
+        put_u32(_records, lines[i].size);
+        put_u16(_records, lines[i].file_id);
+        put_u16(_records, 0);
+        put_u32(_records, lines[i].line);
+    }
+    for(uint32_t i = 0; i < expansions.size(); i++){
+        put_u32(_records, expansions[i].address);
+        put_u32(_records, _add_string(expansions[i].name));
+        put_u16(_records, expansions[i].file_id);
+        put_u16(_records, 0);
+        put_u32(_records, expansions[i].line);
+    }
+    put_u32(_buf, _strings.size());
+    put_u32(_buf, 0);
+    _buf += _records;
+    _buf += _strings;
+
+    return (out8::write_file(_filename, _buf) < 0) ? -1 : 0;
+}
+
+mapped_file_t::mapped_file_t(){
+    data = nullptr;
+    data_size = 0;
+    mapped = false;
+}
+
+mapped_file_t::~mapped_file_t(){
+    unmap();
+}
+
+bool mapped_file_t::map_file(string _filename){
+    unmap();
+#ifdef MAP8_MMAP
+    int _fd = ::open(_filename.c_str(), O_RDONLY);
+    if(_fd < 0) return false;
+    struct stat _stat;
+    if((fstat(_fd, &_stat) == 0) && (_stat.st_size > 0)){
+        void *_map = mmap(nullptr, _stat.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+        if(_map != MAP_FAILED){
+            data = (const uint8_t*)_map;
+            data_size = _stat.st_size;
+            mapped = true;
+        }
+    }
+    ::close(_fd);
+#else
+    ifstream _file(_filename.c_str(), ios::in | ios::binary);
+    if(!_file.is_open()) return false;
+    buffer.assign((istreambuf_iterator<char>(_file)), istreambuf_iterator<char>());
+    data = buffer.data();
+    data_size = buffer.size();
+#endif
+    return data != nullptr;
+}
+
+void mapped_file_t::unmap(){
+#ifdef MAP8_MMAP
+    if(mapped) munmap((void*)data, data_size);
+#endif
+    buffer.clear();
+    data = nullptr;
+    data_size = 0;
+    mapped = false;
+}
+
+uint32_t mapped_file_t::get_u32(size_t _pos){
+    return get_u16(_pos) | ((uint32_t)get_u16(_pos + 2) << 16);
+}
+
+uint16_t mapped_file_t::get_u16(size_t _pos){
+    if(_pos + 2 > data_size) return 0;
+    return data[_pos] | (data[_pos + 1] << 8);
+}
+
+//A NUL terminated string at _pos, "" when it runs past the end:
+const char *mapped_file_t::get_cstring(size_t _pos){
+    if((_pos >= data_size) || (memchr(data + _pos, '\0', data_size - _pos) == nullptr)) return "";
+    return (const char*)(data + _pos);
+}
+
+//Maps the file read-only; the tables are used in place, nothing is parsed:
+bool map8::open(string _filename){
+    if(!map_file(_filename)) return false;
+    if((data_size < MAP8_HEADER_SIZE) || (memcmp(data, MAP8_MAGIC, 4) != 0) || (get_u16(4) != MAP8_VERSION) ||
+       (record(4, 0) + get_u32(24) > data_size)){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void map8::close(){
+    unmap();
+}
+
+//Finds the line table entry that covers _addr:
+bool map8::find_line(uint32_t _addr, string &_file, uint32_t &_line){
+    if(data == nullptr) return false;
+    uint32_t _low = 0, _high = get_u32(16);
+    while(_low < _high){
+        uint32_t _mid = (_low + _high) / 2;
+        if(get_u32(record(2, _mid)) <= _addr) _low = _mid + 1;
+        else                                  _high = _mid;
+    }
+    if(_low == 0) return false;
+    size_t _pos = record(2, _low - 1);
+    if(_addr >= get_u32(_pos) + get_u32(_pos + 4)) return false;
+    uint16_t _file_id = get_u16(_pos + 8);
+    _file = (_file_id < get_u32(8)) ? get_string(get_u32(record(0, _file_id))) : "?";
+    _line = get_u32(_pos + 12);
+    return true;
+}
+
+//Finds the closest label at or below _addr:
+bool map8::find_symbol(uint32_t _addr, string &_name, uint32_t &_offset){
+    if(data == nullptr) return false;
+    uint32_t _low = 0, _high = get_u32(12);
+    while(_low < _high){
+        uint32_t _mid = (_low + _high) / 2;
+        size_t _pos = record(1, _mid);
+        if((data[_pos + 8] == map_symbol_t::symbol_label) && (get_u32(_pos + 4) <= _addr)) _low = _mid + 1;
+        else                                                                             _high = _mid;
+    }
+    if(_low == 0) return false;
+    size_t _pos = record(1, _low - 1);
+    _name = get_string(get_u32(_pos));
+    _offset = _addr - get_u32(_pos + 4);
+    return true;
+}
+
+const char *map8::get_string(uint32_t _offset){
+    return get_cstring(record(4, 0) + _offset);
+}
+
+//Byte offset of record _index in table _table (0 files, 1 symbols, 2 lines,
+//3 expansions, 4 strings):
+size_t map8::record(uint32_t _table, uint32_t _index){
+    size_t _pos = MAP8_HEADER_SIZE;
+    if(_table > 0) _pos += (size_t)get_u32(8) * MAP8_FILE_SIZE;
+    if(_table > 1) _pos += (size_t)get_u32(12) * MAP8_RECORD_SIZE;
+    if(_table > 2) _pos += (size_t)get_u32(16) * MAP8_RECORD_SIZE;
+    if(_table > 3) _pos += (size_t)get_u32(20) * MAP8_RECORD_SIZE;
+    return _pos + (size_t)_index * ((_table == 0) ? MAP8_FILE_SIZE : MAP8_RECORD_SIZE);
+}
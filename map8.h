@@ -0,0 +1,92 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Symbol Maps
+ * Writes symbols, macro expansion sites and the address to source line table,
+ * and looks addresses up in a memory mapped binary map
+*/
+
+#ifndef MAP8_H_
+#define MAP8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+//Binary layout, all values little endian: a 32 byte header, then fixed size
+//file, symbol, line and expansion records and finally the NUL terminated
+//strings the records point to. Symbols, lines and expansions are sorted by
+//address, so a mapped file can be searched as it is:
+#define MAP8_MAGIC          "A8MP"
+#define MAP8_VERSION        1
+#define MAP8_HEADER_SIZE    32
+#define MAP8_FILE_SIZE      4
+#define MAP8_RECORD_SIZE    16
+
+class map_symbol_t{
+    public:
+        enum symbol_kind {symbol_label = 0, symbol_define = 1};
+
+        string      name;
+        uint32_t    value;
+        uint8_t     kind;
+        uint16_t    file_id;
+        uint32_t    line;
+
+        map_symbol_t(string _name = "", uint32_t _value = 0, uint8_t _kind = symbol_label, uint16_t _file_id = 0, uint32_t _line = 0);
+};
+
+//A line table entry covers _size bytes starting at address; an expansion
+//site has no size, the name is the expanded macro:
+class map_line_t{
+    public:
+        uint32_t    address;
+        uint32_t    size;
+        string      name;
+        uint16_t    file_id;
+        uint32_t    line;
+
+        map_line_t(uint32_t _address = 0, uint32_t _size = 0, string _name = "", uint16_t _file_id = 0, uint32_t _line = 0);
+};
+
+//A read-only file, memory mapped where mmap exists and read into buffer
+//otherwise; values in it are little endian:
+class mapped_file_t{
+    public:
+        const uint8_t   *data;
+        size_t          data_size;
+        bool            mapped;
+        vector<uint8_t> buffer;
+
+        mapped_file_t();
+        ~mapped_file_t();
+        bool map_file(string _filename);
+        void unmap();
+        uint32_t get_u32(size_t _pos);
+        uint16_t get_u16(size_t _pos);
+        const char *get_cstring(size_t _pos);
+};
+
+class map8 : public mapped_file_t{
+    public:
+        vector<string>          files;
+        vector<map_symbol_t>    symbols;
+        vector<map_line_t>      lines;
+        vector<map_line_t>      expansions;
+
+        void sort();
+        int write_text(string _filename);
+        int write_binary(string _filename);
+
+        bool open(string _filename);
+        void close();
+        bool find_line(uint32_t _addr, string &_file, uint32_t &_line);
+        bool find_symbol(uint32_t _addr, string &_name, uint32_t &_offset);
+
+        const char *get_string(uint32_t _offset);
+        size_t record(uint32_t _table, uint32_t _index);
+};
+
+#endif /* MAP8_H_ */
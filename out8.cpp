@@ -0,0 +1,185 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Output Formats
+ * Writes the assembled image as flat binary, Intel HEX or Motorola S-records
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <atomic>
+#include "out8.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+segment_t::segment_t(uint32_t _start, uint32_t _length){
+    start = _start;
+    length = _length;
+}
+
+bool out8::parse_format(string _name, format_t &_format){
+    if(_name == "bin")          _format = format_bin;
+    else if(_name == "hex")     _format = format_hex;
+    else if(_name == "srec")    _format = format_srec;
+    else return false;
+    return true;
+}
+
+string out8::extension(format_t _format){
+    if(_format == format_hex)       return ".hex";
+    else if(_format == format_srec) return ".s19";
+    else                            return ".bin";
+}
+
+//Extends the last segment when the byte follows it, otherwise opens a new one:
+void out8::add_byte(vector<segment_t> &_segments, uint32_t _addr){
+    if((_segments.size() > 0) && (_segments.back().start + _segments.back().length == _addr)) _segments.back().length++;
+    else _segments.push_back(segment_t(_addr, 1));
+}
+
+vector<segment_t> out8::get_segments(const vector<bool> &_used, uint32_t _size){
+    vector<segment_t> _segments;
+    for(uint32_t i = 0; (i < _used.size()) && (i < _size); i++) if(_used[i]) add_byte(_segments, i);
+    return _segments;
+}
+
+//The whole file is formatted into one buffer and written at once; the flat
+//binary keeps the fill bytes, the record formats only carry the segments:
+int out8::write(string _filename, format_t _format, const vector<uint8_t> &_image, const vector<segment_t> &_segments){
+    string _buf;
+    if(_format == format_bin){
+        _buf.assign(_image.begin(), _image.end());
+    }
+    else if(_format == format_hex){
+        uint32_t _upper = 0;
+        for(uint32_t i = 0; i < _segments.size(); i++){
+            uint32_t j = 0;
+            while(j < _segments[i].length){
+                uint32_t _addr = _segments[i].start + j;
+                uint32_t _size = min((uint32_t)OUT8_RECORD_SIZE, _segments[i].length - j);
+                //A record must not cross a 64K boundary, beyond it an extended linear address is set:
+                if(((_addr & 0xFFFF) + _size) > 0x10000) _size = 0x10000 - (_addr & 0xFFFF);
+                if((_addr >> 16) != _upper){
+                    _upper = _addr >> 16;
+                    uint8_t _ela[2] = {(uint8_t)(_upper >> 8), (uint8_t)_upper};
+                    hex_record(_buf, 0x04, 0, _ela, 2);
+                }
+                hex_record(_buf, 0x00, _addr & 0xFFFF, &_image[_addr], _size);
+                j += _size;
+            }
+        }
+        hex_record(_buf, 0x01, 0, nullptr, 0);
+    }
+    else{
+        //S1/S9 for 16-bit addresses, S2/S8 when the image is larger:
+        bool _wide = (_segments.size() > 0) && (_segments.back().start + _segments.back().length > 0x10000);
+        srec_record(_buf, '0', 0, 2, nullptr, 0);
+        for(uint32_t i = 0; i < _segments.size(); i++){
+            for(uint32_t j = 0; j < _segments[i].length; j += OUT8_RECORD_SIZE){
+                uint32_t _addr = _segments[i].start + j;
+                uint32_t _size = min((uint32_t)OUT8_RECORD_SIZE, _segments[i].length - j);
+                srec_record(_buf, _wide ? '2' : '1', _addr, _wide ? 3 : 2, &_image[_addr], _size);
+            }
+        }
+        srec_record(_buf, _wide ? '8' : '9', 0, _wide ? 3 : 2, nullptr, 0);
+    }
+
+    return write_file(_filename, _buf);
+}
+
+//Returns 1 and leaves the file alone when it already holds these bytes, so
+//its timestamp only changes with its content. Otherwise the bytes are written
+//next to the target and renamed over it, nobody ever sees half a file. The
+//process id and a counter keep writers of the same file apart:
+int out8::write_file(string _filename, const string &_buf){
+    static atomic<uint32_t> _count(0);
+    string _old;
+    if(read_file(_filename, _old) && (_old == _buf)) return 1;
+    
+    string _temp = _filename + "." + to_string((long long)getpid()) + "." + to_string(_count++) + ".tmp";
+    ofstream _file(_temp.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!_file.is_open()) return -1;
+    _file.write(_buf.data(), _buf.size());
+    _file.close();
+    if(_file.fail()){
+        remove(_temp.c_str());
+        return -1;
+    }
+    if((rename(_temp.c_str(), _filename.c_str()) != 0) && ((remove(_filename.c_str()) != 0) || (rename(_temp.c_str(), _filename.c_str()) != 0))){
+        remove(_temp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+//:LLAAAATT<data>CC, the checksum is the two's complement of the byte sum:
+void out8::hex_record(string &_buf, uint8_t _type, uint16_t _addr, const uint8_t *_data, uint32_t _size){
+    uint8_t _sum = _size + (_addr >> 8) + (_addr & 0xFF) + _type;
+    _buf += ':';
+    put_hex(_buf, _size);
+    put_hex(_buf, _addr >> 8);
+    put_hex(_buf, _addr & 0xFF);
+    put_hex(_buf, _type);
+    for(uint32_t i = 0; i < _size; i++){
+        put_hex(_buf, _data[i]);
+        _sum += _data[i];
+    }
+    put_hex(_buf, (uint8_t)(0x100 - _sum));
+    _buf += '\n';
+}
+
+//S<type><count><address><data>CC, the count includes address and checksum,
+//the checksum is the one's complement of the byte sum:
+void out8::srec_record(string &_buf, char _type, uint32_t _addr, uint8_t _addr_size, const uint8_t *_data, uint32_t _size){
+    uint8_t _count = _addr_size + _size + 1;
+    uint8_t _sum = _count;
+    _buf += 'S';
+    _buf += _type;
+    put_hex(_buf, _count);
+    for(uint32_t i = _addr_size; i > 0; i--){
+        uint8_t _byte = (_addr >> ((i - 1) * 8)) & 0xFF;
+        put_hex(_buf, _byte);
+        _sum += _byte;
+    }
+    for(uint32_t i = 0; i < _size; i++){
+        put_hex(_buf, _data[i]);
+        _sum += _data[i];
+    }
+    put_hex(_buf, ~_sum);
+    _buf += '\n';
+}
+
+bool out8::read_file(string _filename, string &_buf){
+    ifstream _file(_filename.c_str(), ios::in | ios::binary);
+    if(!_file.is_open()) return false;
+    try{
+        _buf.assign((istreambuf_iterator<char>(_file)), istreambuf_iterator<char>());
+    }
+    catch(...){
+        return false;
+    }
+    return true;
+}
+
+//64-bit FNV-1a:
+uint64_t out8::hash(const string &_data, uint64_t _hash){
+    for(size_t i = 0; i < _data.size(); i++){
+        _hash ^= (uint8_t)_data[i];
+        _hash *= OUT8_HASH_PRIME;
+    }
+    return _hash;
+}
+
+void out8::put_hex(string &_buf, uint8_t _byte){
+    const char _digits[] = "0123456789ABCDEF";
+    _buf += _digits[_byte >> 4];
+    _buf += _digits[_byte & 0x0F];
+}
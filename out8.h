@@ -0,0 +1,49 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Output Formats
+ * Writes the assembled image as flat binary, Intel HEX or Motorola S-records
+*/
+
+#ifndef OUT8_H_
+#define OUT8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#define OUT8_RECORD_SIZE    16
+#define OUT8_HASH_SEED      0xCBF29CE484222325ULL
+#define OUT8_HASH_PRIME     0x100000001B3ULL
+
+//A run of image bytes that was actually written by code or data, fill bytes
+//between them are not part of any segment:
+class segment_t{
+    public:
+        uint32_t    start;
+        uint32_t    length;
+
+        segment_t(uint32_t _start = 0, uint32_t _length = 0);
+};
+
+class out8{
+    public:
+        enum format_t {format_bin = 0, format_hex = 1, format_srec = 2};
+
+        static bool parse_format(string _name, format_t &_format);
+        static string extension(format_t _format);
+        static void add_byte(vector<segment_t> &_segments, uint32_t _addr);
+        static vector<segment_t> get_segments(const vector<bool> &_used, uint32_t _size);
+        static int write(string _filename, format_t _format, const vector<uint8_t> &_image, const vector<segment_t> &_segments);
+        static int write_file(string _filename, const string &_buf);
+        static bool read_file(string _filename, string &_buf);
+        static uint64_t hash(const string &_data, uint64_t _hash = OUT8_HASH_SEED);
+
+        static void hex_record(string &_buf, uint8_t _type, uint16_t _addr, const uint8_t *_data, uint32_t _size);
+        static void srec_record(string &_buf, char _type, uint32_t _addr, uint8_t _addr_size, const uint8_t *_data, uint32_t _size);
+        static void put_hex(string &_buf, uint8_t _byte);
+};
+
+#endif /* OUT8_H_ */
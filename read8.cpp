@@ -0,0 +1,163 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Pipelined Source Reader
+ * Loads and lexes source files on a separate thread, ahead of the passes
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "read8.h"
+#include "lex8.h"
+#include "trace8.h"
+
+lexed_file_t::lexed_file_t(string _filename){
+    filename = _filename;
+    opened = false;
+}
+
+read8::read8(){
+    running.store(false);
+    files.clear();
+    requested.clear();
+}
+
+read8::~read8(){
+    stop();
+}
+
+void read8::start(){
+    if(running.load()) return;
+    preloaded.clear();
+    for(map<string, shared_ptr<const lexed_file_t>>::iterator _it = files.begin(); _it != files.end(); _it++) preloaded.insert(_it->first);
+    running.store(true);
+    worker = thread(&read8::run, this);
+}
+
+void read8::stop(){
+    if(!running.load()) return;
+    running.store(false);
+    if(worker.joinable()) worker.join();
+
+    lexed_file_t *_file;
+    while(results.pop(_file)) delete _file;
+    string *_filename;
+    while(requests.pop(_filename)) delete _filename;
+}
+
+//Asks the reader thread for a file; files it already loads are ignored there:
+void read8::request(string _filename){
+    _filename = convert_slash(_filename);
+    if(!running.load() || (files.find(_filename) != files.end()) || !requested.insert(_filename).second) return;
+    string *_request = new string(_filename);
+    while(!requests.push(_request)) this_thread::yield();
+}
+
+//Waits until the reader thread delivered the file, or loads it right here
+//when the reader is not running:
+shared_ptr<const lexed_file_t> read8::get(string _filename){
+    _filename = convert_slash(_filename);
+    map<string, shared_ptr<const lexed_file_t>>::iterator _it = files.find(_filename);
+    if(_it != files.end()) return _it->second;
+
+    if(!running.load()){
+        files[_filename] = shared_ptr<const lexed_file_t>(load(_filename));
+        return files[_filename];
+    }
+
+    request(_filename);
+    trace_span_t _span("read", "wait", _filename);
+    while(true){
+        lexed_file_t *_file;
+        while(results.pop(_file)) files[_file->filename] = shared_ptr<const lexed_file_t>(_file);
+        if((_it = files.find(_filename)) != files.end()) return _it->second;
+        this_thread::yield();
+    }
+}
+
+//Reader thread: loads requested files in order and queues the files they
+//include right behind them, before the passes get to the .include line:
+void read8::run(){
+    trace8::name_thread("reader");
+    set<string> _seen = preloaded;
+    deque<string> _queue;
+    while(running.load()){
+        string *_request;
+        while(requests.pop(_request)){
+            if(_seen.insert(*_request).second) _queue.push_back(*_request);
+            delete _request;
+        }
+        if(_queue.size() < 1){
+            this_thread::sleep_for(chrono::microseconds(50));
+            continue;
+        }
+
+        lexed_file_t *_file = load(_queue.front());
+        _queue.pop_front();
+
+        vector<string> _includes;
+        for(uint32_t i = 0; i < _file->lines.size(); i++){
+            const line_t &_code = _file->lines[i];
+            if((_code.size() > 1) && (_code[0] == ".include") && (_code[1].length() > 2)){
+                string _include = include_path(_file->filename, _code);
+                if(_seen.insert(_include).second) _includes.push_back(_include);
+            }
+        }
+        for(uint32_t i = _includes.size(); i > 0; i--) _queue.push_front(_includes[i - 1]);
+
+        while(!results.push(_file)){
+            if(!running.load()){
+                delete _file;
+                return;
+            }
+            this_thread::yield();
+        }
+    }
+}
+
+//Reads the whole file and lets the scanner lowercase it and split every
+//line into words; comments are dropped here already:
+lexed_file_t *read8::load(string _filename){
+    trace_span_t _span("read", "load", _filename);
+    lexed_file_t *_file = new lexed_file_t(convert_slash(_filename));
+    ifstream _ifile(_file->filename.c_str(), ios::in | ios::binary);
+    if(!_ifile.is_open()) return _file;
+    _file->opened = true;
+
+    string _content;
+    try{
+        _content.assign((istreambuf_iterator<char>(_ifile)), istreambuf_iterator<char>());
+    }
+    catch(...){
+        _file->opened = false;
+        return _file;
+    }
+    _ifile.close();
+    lex8::scan(_content, _file->lines);
+    return _file;
+}
+
+string read8::convert_slash(string _filename){
+    size_t i;
+    while((i = _filename.find("\\")) != string::npos) _filename[i] = '/';
+    return _filename;
+}
+
+//Directory part of a path as it was written, with the last slash ("" for
+//none); paths built from it keep their spelling, "./a.asm" stays "./a.asm":
+string read8::dir_prefix(const string &_filename){
+    size_t _slash = _filename.rfind('/');
+    return (_slash != string::npos) ? _filename.substr(0, _slash + 1) : "";
+}
+
+//An included path is relative to the directory of the including file; the
+//lexer splits it at '/', so the words after .include are joined again:
+string read8::include_path(const string &_parent, const line_t &_code){
+    string _arg;
+    for(uint32_t i = 1; i < _code.size(); i++) _arg += _code[i];
+    string _filename = dir_prefix(_parent);
+    _filename += _arg.substr(_arg.find('\"') + 1, (_arg.rfind('\"') - (_arg.find('\"') + 1)));
+    return convert_slash(_filename);
+}
@@ -0,0 +1,103 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Pipelined Source Reader
+ * Loads and lexes source files on a separate thread, ahead of the passes
+*/
+
+#ifndef READ8_H_
+#define READ8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <stdint.h>
+#include "vec8.h"
+
+#define READ8_RING_SIZE         64
+#define READ8_SPECIAL_CHAR      ",()<>+-*/"
+#define READ8_LINE_WORDS        8
+
+//Lock-free ring for exactly one producer and one consumer thread; head is
+//only written by the consumer, tail only by the producer:
+template<typename T> class spsc_ring_t{
+    public:
+        T                   slots[READ8_RING_SIZE];
+        atomic<uint32_t>    head;
+        atomic<uint32_t>    tail;
+
+        spsc_ring_t(){
+            head.store(0);
+            tail.store(0);
+        }
+
+        bool push(const T &_value){
+            uint32_t _tail = tail.load(memory_order_relaxed);
+            if(_tail - head.load(memory_order_acquire) >= READ8_RING_SIZE) return false;
+            slots[_tail % READ8_RING_SIZE] = _value;
+            tail.store(_tail + 1, memory_order_release);
+            return true;
+        }
+
+        bool pop(T &_value){
+            uint32_t _head = head.load(memory_order_relaxed);
+            if(_head == tail.load(memory_order_acquire)) return false;
+            _value = slots[_head % READ8_RING_SIZE];
+            head.store(_head + 1, memory_order_release);
+            return true;
+        }
+};
+
+//One lexed source line; almost all lines fit the inline words, and the words
+//themselves are short enough for the inline buffer of string:
+typedef small_vector_t<string, READ8_LINE_WORDS> line_t;
+
+//vector<line_t> only moves its lines when it grows if that can not throw:
+static_assert(is_nothrow_move_constructible<line_t>::value, "line_t must be nothrow movable");
+
+//A source file as the passes see it: lowercased and split into words per line:
+class lexed_file_t{
+    public:
+        string                  filename;
+        bool                    opened;
+        vector<line_t>          lines;
+
+        lexed_file_t(string _filename);
+};
+
+class read8{
+    public:
+        spsc_ring_t<string*>        requests;
+        spsc_ring_t<lexed_file_t*>  results;
+        atomic<bool>                running;
+        thread                      worker;
+
+        //Only touched by the main thread:
+        map<string, shared_ptr<const lexed_file_t>> files;
+        set<string>                 requested;
+        //Files that were cached before start(), the reader does not load them again:
+        set<string>                 preloaded;
+
+        read8();
+        ~read8();
+        void start();
+        void stop();
+        void request(string _filename);
+        shared_ptr<const lexed_file_t> get(string _filename);
+        void run();
+
+        static lexed_file_t *load(string _filename);
+        static string convert_slash(string _filename);
+        static string dir_prefix(const string &_filename);
+        static string include_path(const string &_parent, const line_t &_code);
+};
+
+#endif /* READ8_H_ */
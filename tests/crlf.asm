@@ -0,0 +1,6 @@
+; test: ! asm8 crlf.asm -o {tmp}/crlf.bin 2> {out}
+; CRLF line ends: "\r\n" is one line end, so the error is on line 5.
+    lai 1
+
+    foo 2
+    lbi 3
@@ -0,0 +1,7 @@
+; test: asm8 -f hex formats.asm -o {tmp}/formats.hex && asm8 -f srec formats.asm -o {tmp}/formats.s19 && cat {tmp}/formats.hex {tmp}/formats.s19 > {out}
+; Intel HEX, then S-records: a record longer than 16 bytes is split, and the
+; .org gap between the two ranges is not written.
+    lai 1
+    .fill 18, 0x55
+    .org 0x100
+    jmp 0x100
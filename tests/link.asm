@@ -0,0 +1,13 @@
+; test: asm8 -c link.asm -o {tmp}/link.o8 && asm8 -c link_lib.asm -o {tmp}/link_lib.o8 && asm8 --link {tmp}/link.o8 {tmp}/link_lib.o8 --link-base 0x10 -o {out}
+; Two modules linked at 0x10: a call into the other module, a low/high byte
+; pair and .dw words of local labels, all relocated; link_lib.asm is the other.
+.extern double
+.global table
+start:
+    cal double
+    lhi (>table)
+    lli (<table)
+    jmp start
+table:
+    .dw start
+    .dw table
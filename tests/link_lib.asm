@@ -0,0 +1,7 @@
+; Helper module of link.asm: doubles A and reads the first byte of table.
+.extern table
+.global double
+double:
+    add
+    lli (<table + 1)
+    ret
@@ -0,0 +1,13 @@
+; test: asm8 literals.asm -o {out}
+; Number literal forms; every .db line expects the bytes in its comment.
+    .db 0bfh        ; 0xBF, hex suffix although it starts like 0b
+    .db 0b1h        ; 0xB1
+    .db 0b101       ; 0x05, binary prefix
+    .db 101b        ; 0x05, binary suffix
+    .db 0o17        ; 0x0F, octal prefix
+    .db 17o, 17q    ; 0x0F, 0x0F
+    .db 0x1b        ; 0x1B, hex prefix ending in b
+    .db 0x1d        ; 0x1D, hex prefix ending in d
+    .db 1fh, $1f    ; 0x1F, 0x1F
+    .db %101, 12d   ; 0x05, 0x0C
+    .db 12, 'a'     ; 0x0C, 0x61
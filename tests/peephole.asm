@@ -0,0 +1,18 @@
+; test: asm8 -O peephole.asm -o {out}
+; -O on code it must keep: "lai x" loads the address of label x (3), only
+; a number literal 0 becomes xra. The chain a -> b -> c is threaded.
+    jmp a
+x:
+    lai x
+    add
+    lai 0x0
+    add
+    jmp x
+a:
+    jmp b
+b:
+    jmp c
+c:
+    lai 0
+    cpi 1
+    halt
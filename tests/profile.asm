@@ -0,0 +1,7 @@
+; test: asm8 profile.asm -o {tmp}/profile.bin --profile {out}
+; CRLF source: the cycles of the loop must land on the deb/jfz lines.
+    lbi 3
+loop:
+    deb
+    jfz loop
+    halt
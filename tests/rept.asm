@@ -0,0 +1,15 @@
+; test: asm8 rept.asm -o {out}
+; .rept with a counter, .fill with and without a value and .dw words,
+; including a label from behind the block.
+    .rept 3, i
+    lai (i + 0x10)
+    .db i
+    .endr
+    .fill 2
+    .fill 3, 0xAA
+    .dw 0x1234, end, (end + 1)
+    .rept 2
+    .dw 0xBEEF
+    .endr
+end:
+    halt
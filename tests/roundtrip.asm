@@ -0,0 +1,16 @@
+; test: asm8 --roundtrip roundtrip.asm literals.asm rept.asm
+; Assembled, disassembled with its labels and assembled again, every file
+; must give the same image: calls, jumps, data and raw opcode bytes.
+start:
+    lai 0x10
+    cal sub
+    jfz start
+    .db 0x00, 0x07, 0x0F
+    .dw start
+    jmp end
+sub:
+    add
+    rfc
+    ret
+end:
+    halt
@@ -0,0 +1,25 @@
+#!/bin/sh
+# ASM8 tests: every tests/*.asm with a "; test:" line is one test. The rest
+# of that line is a shell command run in this directory, where asm8 is the
+# assembler under test, {tmp} a scratch directory and {out} the file that
+# must equal <name>.out when that exists. Usage: tests/run.sh [path/to/asm8]
+ASM8=$(cd "$(dirname "${1:-./asm8}")" && pwd)/$(basename "${1:-./asm8}")
+cd "$(dirname "$0")" || exit 1
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+asm8(){ "$ASM8" "$@"; }
+fail=0
+for src in *.asm; do
+    cmd=$(sed -n 's/^; test: //p' "$src" | tr -d '\r' | head -n 1)
+    [ -z "$cmd" ] && continue
+    name=${src%.asm}
+    cmd=$(printf '%s' "$cmd" | sed "s#{tmp}#$TMP#g; s#{out}#$TMP/$name.out#g")
+    if ! (eval "$cmd") > "$TMP/$name.log" 2>&1; then
+        echo "FAIL $name"; sed 's/^/    /' "$TMP/$name.log" | tail -n 5; fail=1
+    elif [ -f "$name.out" ] && ! cmp -s "$TMP/$name.out" "$name.out"; then
+        echo "DIFF $name"; fail=1
+    else
+        echo "ok   $name"
+    fi
+done
+exit $fail
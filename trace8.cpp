@@ -0,0 +1,158 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Trace Recorder
+ * Records timed spans per thread and writes them in the Chrome trace format
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include "trace8.h"
+
+atomic<bool> trace8::enabled(false);
+mutex trace8::rings_mutex;
+vector<unique_ptr<trace_ring_t>> trace8::rings;
+atomic<uint32_t> trace8::generation(0);
+uint64_t trace8::epoch = 0;
+
+//Every thread finds its ring here; a ring of an older generation was freed:
+static thread_local trace_ring_t *thread_ring = nullptr;
+static thread_local uint32_t thread_generation = 0;
+
+trace_ring_t::trace_ring_t(uint32_t _tid){
+    tid = _tid;
+    thread_name = "thread " + to_string(_tid);
+    events.resize(TRACE8_RING_SIZE);
+    count = 0;
+}
+
+//Drops the spans of an earlier start, the thread calling it is "main":
+void trace8::start(){
+    {
+        lock_guard<mutex> _lock(rings_mutex);
+        rings.clear();
+        generation++;
+    }
+    epoch = 0;
+    epoch = now();
+    enabled.store(true);
+    name_thread("main");
+}
+
+void trace8::stop(){
+    enabled.store(false);
+}
+
+void trace8::name_thread(string _name){
+    if(!enabled.load(memory_order_relaxed)) return;
+    ring()->thread_name = _name;
+}
+
+uint64_t trace8::now(){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() - epoch;
+}
+
+trace_ring_t *trace8::ring(){
+    uint32_t _generation = generation.load(memory_order_acquire);
+    if((thread_ring != nullptr) && (thread_generation == _generation)) return thread_ring;
+    lock_guard<mutex> _lock(rings_mutex);
+    rings.push_back(unique_ptr<trace_ring_t>(new trace_ring_t(rings.size() + 1)));
+    thread_ring = rings.back().get();
+    thread_generation = _generation;
+    return thread_ring;
+}
+
+void trace8::record(const char *_category, const char *_name, const string &_arg, uint64_t _start, uint64_t _end){
+    if(!enabled.load(memory_order_relaxed)) return;
+    trace_ring_t *_ring = ring();
+    trace_event_t &_event = _ring->events[_ring->count % TRACE8_RING_SIZE];
+    _event.category = _category;
+    _event.name = _name;
+    _event.arg = _arg;
+    _event.start = _start;
+    _event.duration = _end - _start;
+    _ring->count++;
+}
+
+string trace8::json_string(const string &_str){
+    string _out = "\"";
+    for(uint32_t i = 0; i < _str.length(); i++){
+        if((_str[i] == '\"') || (_str[i] == '\\')) _out += '\\';
+        if((uint8_t)_str[i] < 0x20) continue;
+        _out += _str[i];
+    }
+    return _out + "\"";
+}
+
+//Complete events ("ph":"X") with microsecond timestamps, plus the thread
+//names; the other threads must have finished before this is called:
+int trace8::write(string _filename){
+    lock_guard<mutex> _lock(rings_mutex);
+    ofstream _file(_filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!_file.is_open()){
+        cerr << "Could not create/overwrite file: " << _filename << endl;
+        return -1;
+    }
+
+    char _buf[64];
+    uint64_t _dropped = 0;
+    bool _first = true;
+    _file << "{\"traceEvents\":[";
+    for(uint32_t i = 0; i < rings.size(); i++){
+        const trace_ring_t &_ring = *rings[i];
+        _file << (_first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << _ring.tid << ",\"args\":{\"name\":" << json_string(_ring.thread_name) << "}}";
+        _first = false;
+
+        uint64_t _oldest = (_ring.count > TRACE8_RING_SIZE) ? (_ring.count - TRACE8_RING_SIZE) : 0;
+        _dropped += _oldest;
+        for(uint64_t j = _oldest; j < _ring.count; j++){
+            const trace_event_t &_event = _ring.events[j % TRACE8_RING_SIZE];
+            snprintf(_buf, sizeof(_buf), "\"ts\":%.3f,\"dur\":%.3f", _event.start / 1000.0, _event.duration / 1000.0);
+            _file << ",\n{\"ph\":\"X\",\"cat\":" << json_string(_event.category) << ",\"name\":" << json_string(_event.name) << ",\"pid\":1,\"tid\":" << _ring.tid << "," << _buf;
+            if(_event.arg != "") _file << ",\"args\":{\"name\":" << json_string(_event.arg) << "}";
+            _file << "}";
+        }
+    }
+    _file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_spans\":" << _dropped << "}}\n";
+
+    if(!_file.good()){
+        cerr << "Could not write file: " << _filename << endl;
+        return -1;
+    }
+    cout << "Trace saved to: " << _filename << endl;
+    return 0;
+}
+
+trace_span_t::trace_span_t(const char *_category, const char *_name, const string &_arg){
+    category = _category;
+    name = _name;
+    active = trace8::enabled.load(memory_order_relaxed);
+    start = 0;
+    if(!active) return;
+    arg = _arg;
+    start = trace8::now();
+}
+
+trace_span_t::~trace_span_t(){
+    end();
+}
+
+void trace_span_t::end(){
+    if(!active) return;
+    active = false;
+    trace8::record(category, name, arg, start, trace8::now());
+}
+
+trace_session_t::trace_session_t(string _filename){
+    filename = _filename;
+    if(filename != "") trace8::start();
+}
+
+trace_session_t::~trace_session_t(){
+    if(filename == "") return;
+    trace8::stop();
+    trace8::write(filename);
+}
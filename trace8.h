@@ -0,0 +1,90 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Trace Recorder
+ * Records timed spans per thread and writes them in the Chrome trace format
+*/
+
+#ifndef TRACE8_H_
+#define TRACE8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#define TRACE8_RING_SIZE    16384
+
+//One finished span; category and name are string literals, only the
+//argument (a file or macro name) is copied:
+class trace_event_t{
+    public:
+        const char  *category;
+        const char  *name;
+        string      arg;
+        uint64_t    start;
+        uint64_t    duration;
+};
+
+//Spans of one thread. Only that thread writes to it, so recording takes no
+//lock; when it is full the oldest spans are overwritten:
+class trace_ring_t{
+    public:
+        uint32_t                tid;
+        string                  thread_name;
+        vector<trace_event_t>   events;
+        uint64_t                count;
+
+        trace_ring_t(uint32_t _tid);
+};
+
+class trace8{
+    public:
+        static atomic<bool>     enabled;
+
+        static void start();
+        static void stop();
+        static void name_thread(string _name);
+        static uint64_t now();
+        static void record(const char *_category, const char *_name, const string &_arg, uint64_t _start, uint64_t _end);
+        static int write(string _filename);
+
+    private:
+        static mutex                            rings_mutex;
+        static vector<unique_ptr<trace_ring_t>> rings;
+        static atomic<uint32_t>                 generation;
+        static uint64_t                         epoch;
+
+        static trace_ring_t *ring();
+        static string json_string(const string &_str);
+};
+
+//Times the enclosing scope, or up to end(); nothing is copied or read from
+//the clock while tracing is off:
+class trace_span_t{
+    public:
+        const char  *category;
+        const char  *name;
+        string      arg;
+        uint64_t    start;
+        bool        active;
+
+        trace_span_t(const char *_category, const char *_name, const string &_arg = "");
+        ~trace_span_t();
+        void end();
+};
+
+//Starts tracing when a file is given and writes the trace when it goes out of scope:
+class trace_session_t{
+    public:
+        string      filename;
+
+        trace_session_t(string _filename);
+        ~trace_session_t();
+};
+
+#endif /* TRACE8_H_ */
@@ -0,0 +1,222 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Small Vector
+ * Vector with inline storage for its first elements, used for lexed lines
+*/
+
+#ifndef VEC8_H_
+#define VEC8_H_
+
+using namespace std;
+
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <initializer_list>
+#include <stdint.h>
+
+//Vector that keeps its first N elements inside the object and only goes to
+//the heap beyond that; iterators are plain pointers:
+template<typename T, uint32_t N> class small_vector_t{
+    public:
+        typedef T           value_type;
+        typedef T*          iterator;
+        typedef const T*    const_iterator;
+        typedef uint32_t    size_type;
+
+        small_vector_t(){
+            init();
+        }
+
+        small_vector_t(initializer_list<T> _list){
+            init();
+            append(_list.begin(), _list.end());
+        }
+
+        template<typename I> small_vector_t(I _first, I _last){
+            init();
+            append(_first, _last);
+        }
+
+        small_vector_t(const small_vector_t &_other){
+            init();
+            append(_other.begin(), _other.end());
+        }
+
+        small_vector_t(small_vector_t &&_other) noexcept {
+            init();
+            take(_other);
+        }
+
+        ~small_vector_t(){
+            clear();
+            release();
+        }
+
+        small_vector_t &operator=(const small_vector_t &_other){
+            if(this == &_other) return *this;
+            clear();
+            append(_other.begin(), _other.end());
+            return *this;
+        }
+
+        small_vector_t &operator=(small_vector_t &&_other) noexcept {
+            if(this == &_other) return *this;
+            clear();
+            release();
+            init();
+            take(_other);
+            return *this;
+        }
+
+        size_type size() const { return count; }
+        size_type capacity() const { return limit; }
+        bool empty() const { return count == 0; }
+
+        T &operator[](size_type _index){ return items[_index]; }
+        const T &operator[](size_type _index) const { return items[_index]; }
+        T &front(){ return items[0]; }
+        const T &front() const { return items[0]; }
+        T &back(){ return items[count - 1]; }
+        const T &back() const { return items[count - 1]; }
+
+        iterator begin(){ return items; }
+        iterator end(){ return items + count; }
+        const_iterator begin() const { return items; }
+        const_iterator end() const { return items + count; }
+
+        void reserve(size_type _size){
+            if(_size <= limit) return;
+            size_type _limit = limit * 2;
+            if(_limit < _size) _limit = _size;
+            T *_items = static_cast<T*>(::operator new(_limit * sizeof(T)));
+            for(size_type i = 0; i < count; i++){
+                new (_items + i) T(move(items[i]));
+                items[i].~T();
+            }
+            release();
+            items = _items;
+            limit = _limit;
+        }
+
+        void push_back(const T &_value){
+            if(count < limit){
+                new (items + count) T(_value);
+            }
+            else{
+                T _copy(_value);
+                reserve(count + 1);
+                new (items + count) T(move(_copy));
+            }
+            count++;
+        }
+
+        void push_back(T &&_value){
+            if(count >= limit){
+                T _moved(move(_value));
+                reserve(count + 1);
+                new (items + count) T(move(_moved));
+            }
+            else new (items + count) T(move(_value));
+            count++;
+        }
+
+        void pop_back(){
+            items[--count].~T();
+        }
+
+        void resize(size_type _size){
+            reserve(_size);
+            while(count < _size) new (items + count++) T();
+            while(count > _size) items[--count].~T();
+        }
+
+        void clear(){
+            while(count > 0) items[--count].~T();
+        }
+
+        template<typename I> void assign(I _first, I _last){
+            small_vector_t _copy(_first, _last);
+            *this = move(_copy);
+        }
+
+        iterator insert(const_iterator _pos, T _value){
+            size_type _index = _pos - items;
+            push_back(move(_value));
+            for(size_type i = count - 1; i > _index; i--) swap(items[i], items[i - 1]);
+            return items + _index;
+        }
+
+        template<typename I> iterator insert(const_iterator _pos, I _first, I _last){
+            size_type _index = _pos - items;
+            size_type _old = count;
+            small_vector_t _copy(_first, _last);
+            reserve(count + _copy.size());
+            for(size_type i = 0; i < _copy.size(); i++) push_back(move(_copy[i]));
+            rotate(items + _index, items + _old, items + count);
+            return items + _index;
+        }
+
+        iterator erase(const_iterator _pos){
+            return erase(_pos, _pos + 1);
+        }
+
+        iterator erase(const_iterator _first, const_iterator _last){
+            size_type _index = _first - items;
+            size_type _n = _last - _first;
+            if(_n == 0) return items + _index;
+            for(size_type i = _index; i + _n < count; i++) items[i] = move(items[i + _n]);
+            for(size_type i = 0; i < _n; i++) items[--count].~T();
+            return items + _index;
+        }
+
+        bool operator==(const small_vector_t &_other) const {
+            if(count != _other.count) return false;
+            for(size_type i = 0; i < count; i++) if(!(items[i] == _other.items[i])) return false;
+            return true;
+        }
+
+        bool operator!=(const small_vector_t &_other) const {
+            return !(*this == _other);
+        }
+
+        bool operator<(const small_vector_t &_other) const {
+            return lexicographical_compare(begin(), end(), _other.begin(), _other.end());
+        }
+
+    private:
+        T          *items;
+        size_type   count;
+        size_type   limit;
+        alignas(T) unsigned char storage[N * sizeof(T)];
+
+        void init(){
+            items = reinterpret_cast<T*>(storage);
+            count = 0;
+            limit = N;
+        }
+
+        void release(){
+            if(items != reinterpret_cast<T*>(storage)) ::operator delete(items);
+        }
+
+        //Steals the heap block of the other vector, inline elements are moved;
+        //they fit the inline storage, so nothing is allocated here:
+        void take(small_vector_t &_other) noexcept {
+            if(_other.items != reinterpret_cast<T*>(_other.storage)){
+                items = _other.items;
+                count = _other.count;
+                limit = _other.limit;
+                _other.init();
+                return;
+            }
+            for(size_type i = 0; i < _other.count; i++) push_back(move(_other.items[i]));
+            _other.clear();
+        }
+
+        template<typename I> void append(I _first, I _last){
+            for(; _first != _last; ++_first) push_back(*_first);
+        }
+};
+
+#endif /* VEC8_H_ */
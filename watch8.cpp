@@ -0,0 +1,82 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Watch Mode
+ * Waits for changes of the source files with inotify
+*/
+
+using namespace std;
+
+#include <iostream>
+#include "watch8.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+watch8::watch8(){
+    fd = -1;
+    dirs.clear();
+    dir_ids.clear();
+    files.clear();
+}
+
+watch8::~watch8(){
+#ifdef __linux__
+    if(fd >= 0) close(fd);
+#endif
+}
+
+bool watch8::init(){
+#ifdef __linux__
+    fd = inotify_init1(IN_CLOEXEC);
+#endif
+    return fd >= 0;
+}
+
+//Replaces the watched files; directories stay watched once they were added:
+void watch8::watch(const vector<string> &_filenames){
+    files.clear();
+    for(uint32_t i = 0; i < _filenames.size(); i++){
+        files.insert(_filenames[i]);
+        string _dir = read8::dir_prefix(_filenames[i]);
+        if(dir_ids.find(_dir) != dir_ids.end()) continue;
+#ifdef __linux__
+        int _wd = inotify_add_watch(fd, (_dir == "") ? "." : _dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+        if(_wd < 0) continue;
+        dirs[_wd].insert(_dir);
+        dir_ids[_dir] = _wd;
+#endif
+    }
+}
+
+//Blocks until a watched file changed; events that follow within a few
+//milliseconds are collected too, so one save triggers one assembly:
+vector<string> watch8::wait(){
+    set<string> _changed;
+#ifdef __linux__
+    char _buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int _timeout = -1;
+    while(true){
+        struct pollfd _poll = {fd, POLLIN, 0};
+        int _ready = poll(&_poll, 1, _timeout);
+        if(_ready < 0) break;
+        if(_ready == 0){
+            if(_changed.size() > 0) break;
+            continue;
+        }
+        ssize_t _length = read(fd, _buf, sizeof(_buf));
+        if(_length <= 0) break;
+        for(char *_p = _buf; _p < _buf + _length; _p += sizeof(struct inotify_event) + ((struct inotify_event*)_p)->len){
+            struct inotify_event *_event = (struct inotify_event*)_p;
+            if((_event->len == 0) || (dirs.find(_event->wd) == dirs.end())) continue;
+            const set<string> &_dirs = dirs[_event->wd];
+            for(set<string>::const_iterator _dir = _dirs.begin(); _dir != _dirs.end(); _dir++)
+                if(files.find(*_dir + _event->name) != files.end()) _changed.insert(*_dir + _event->name);
+        }
+        if(_changed.size() > 0) _timeout = WATCH8_SETTLE_MS;
+    }
+#endif
+    return vector<string>(_changed.begin(), _changed.end());
+}
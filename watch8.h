@@ -0,0 +1,41 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Watch Mode
+ * Waits for changes of the source files with inotify
+*/
+
+#ifndef WATCH8_H_
+#define WATCH8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include "read8.h"
+
+#define WATCH8_SETTLE_MS    30
+
+//Watches the directories of the files instead of the files themselves, so
+//editors that save by renaming a new file over the old one are seen too.
+//Directories are kept as the paths spell them ("./", "", "src/../"); one
+//watch may stand for several spellings of the same directory:
+class watch8{
+    public:
+        int                     fd;
+        map<int, set<string>>   dirs;
+        map<string, int>        dir_ids;
+        set<string>             files;
+
+        watch8();
+        ~watch8();
+        bool init();
+        void watch(const vector<string> &_filenames);
+        vector<string> wait();
+
+};
+
+#endif /* WATCH8_H_ */
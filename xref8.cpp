@@ -0,0 +1,197 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Cross-Reference Index
+ * Definition and use sites of labels, defines and macros, written as a sorted
+ * binary index that tools map and search in place
+*/
+
+using namespace std;
+
+#include <iostream>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include "xref8.h"
+#include "out8.h"
+
+xref_symbol_t::xref_symbol_t(string _name, uint8_t _kind, uint16_t _file_id, uint32_t _line){
+    name = _name;
+    kind = _kind;
+    file_id = _file_id;
+    line = _line;
+}
+
+xref_use_t::xref_use_t(uint32_t _symbol, uint16_t _file_id, uint32_t _line){
+    symbol = _symbol;
+    file_id = _file_id;
+    line = _line;
+}
+
+bool xref_use_t::operator<(const xref_use_t &_other) const{
+    if(symbol != _other.symbol)     return symbol < _other.symbol;
+    if(file_id != _other.file_id)   return file_id < _other.file_id;
+    return line < _other.line;
+}
+
+bool xref_use_t::operator==(const xref_use_t &_other) const{
+    return (symbol == _other.symbol) && (file_id == _other.file_id) && (line == _other.line);
+}
+
+static void put_u16(string &_buf, uint16_t _value){ _buf += (char)(_value & 0xFF); _buf += (char)(_value >> 8); }
+static void put_u32(string &_buf, uint32_t _value){ put_u16(_buf, _value & 0xFFFF); put_u16(_buf, _value >> 16); }
+
+//Symbols are sorted by name first; a line that uses a symbol more than once
+//(or is encoded more than once, like a .rept body) counts as one use:
+int xref8::write(string _filename){
+    vector<uint32_t> _order(symbols.size());
+    for(uint32_t i = 0; i < _order.size(); i++) _order[i] = i;
+    stable_sort(_order.begin(), _order.end(), [this](uint32_t _a, uint32_t _b){ return symbols[_a].name < symbols[_b].name; });
+    vector<uint32_t> _rank(symbols.size());
+    for(uint32_t i = 0; i < _order.size(); i++) _rank[_order[i]] = i;
+
+    vector<xref_use_t> _uses;
+    for(uint32_t i = 0; i < uses.size(); i++)
+        if(uses[i].symbol < symbols.size()) _uses.push_back(xref_use_t(_rank[uses[i].symbol], uses[i].file_id, uses[i].line));
+    sort(_uses.begin(), _uses.end());
+    _uses.erase(unique(_uses.begin(), _uses.end()), _uses.end());
+
+    vector<uint32_t> _positions(_uses.size());
+    for(uint32_t i = 0; i < _positions.size(); i++) _positions[i] = i;
+    stable_sort(_positions.begin(), _positions.end(), [&_uses](uint32_t _a, uint32_t _b){
+        return (_uses[_a].file_id != _uses[_b].file_id) ? (_uses[_a].file_id < _uses[_b].file_id) : (_uses[_a].line < _uses[_b].line);
+    });
+
+    string _strings;
+    map<string, uint32_t> _string_offsets;
+    auto _add_string = [&](const string &_str) -> uint32_t{
+        map<string, uint32_t>::iterator _it = _string_offsets.find(_str);
+        if(_it != _string_offsets.end()) return _it->second;
+        uint32_t _offset = _strings.size();
+        _strings += _str;
+        _strings += '\0';
+        _string_offsets[_str] = _offset;
+        return _offset;
+    };
+
+    string _records;
+    for(uint32_t i = 0; i < files.size(); i++) put_u32(_records, _add_string(files[i]));
+    uint32_t _first = 0;
+    for(uint32_t i = 0; i < _order.size(); i++){
+        const xref_symbol_t &_symbol = symbols[_order[i]];
+        uint32_t _count = 0;
+        while((_first + _count < _uses.size()) && (_uses[_first + _count].symbol == i)) _count++;
+        put_u32(_records, _add_string(_symbol.name));
+        _records += (char)_symbol.kind;
+        _records += (char)0;
+        put_u16(_records, _symbol.file_id);
+        put_u32(_records, _symbol.line);
+        put_u32(_records, _first);
+        put_u32(_records, _count);
+        _first += _count;
+    }
+    for(uint32_t i = 0; i < _uses.size(); i++){
+        put_u16(_records, _uses[i].file_id);
+        put_u16(_records, 0);
+        put_u32(_records, _uses[i].line);
+        put_u32(_records, _uses[i].symbol);
+    }
+    for(uint32_t i = 0; i < _positions.size(); i++) put_u32(_records, _positions[i]);
+
+    string _buf = XREF8_MAGIC;
+    put_u16(_buf, XREF8_VERSION);
+    put_u16(_buf, 0);
+    put_u32(_buf, files.size());
+    put_u32(_buf, symbols.size());
+    put_u32(_buf, _uses.size());
+    put_u32(_buf, _strings.size());
+    put_u32(_buf, 0);
+    put_u32(_buf, 0);
+    return (out8::write_file(_filename, _buf + _records + _strings) < 0) ? -1 : 0;
+}
+
+bool xref8::open(string _filename){
+    if(!map_file(_filename)) return false;
+    if((data_size < XREF8_HEADER_SIZE) || (memcmp(data, XREF8_MAGIC, 4) != 0) || (get_u16(4) != XREF8_VERSION) ||
+       (table(4) + get_u32(20) > data_size)){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void xref8::close(){
+    unmap();
+}
+
+//Binary search over the symbols, which are sorted by name; -1 if missing:
+int32_t xref8::find(const string &_name){
+    if(data == nullptr) return -1;
+    uint32_t _low = 0, _high = get_u32(12);
+    while(_low < _high){
+        uint32_t _mid = (_low + _high) / 2;
+        if(strcmp(get_cstring(table(4) + get_u32(table(1) + (size_t)_mid * XREF8_SYMBOL_SIZE)), _name.c_str()) < 0) _low = _mid + 1;
+        else                                                                                                        _high = _mid;
+    }
+    if((_low < get_u32(12)) && (get_name(_low) == _name)) return _low;
+    return -1;
+}
+
+//The symbol used in _file at _line, -1 if that line uses none:
+int32_t xref8::find_at(const string &_file, uint32_t _line){
+    if(data == nullptr) return -1;
+    uint32_t _file_id = 0;
+    while((_file_id < get_u32(8)) && (get_file(_file_id) != _file)) _file_id++;
+    if(_file_id >= get_u32(8)) return -1;
+
+    uint32_t _low = 0, _high = get_u32(16);
+    while(_low < _high){
+        uint32_t _mid = (_low + _high) / 2;
+        size_t _use = table(2) + (size_t)get_u32(table(3) + (size_t)_mid * XREF8_POSITION_SIZE) * XREF8_USE_SIZE;
+        if((get_u16(_use) < _file_id) || ((get_u16(_use) == _file_id) && (get_u32(_use + 4) < _line))) _low = _mid + 1;
+        else                                                                                         _high = _mid;
+    }
+    if(_low >= get_u32(16)) return -1;
+    size_t _use = table(2) + (size_t)get_u32(table(3) + (size_t)_low * XREF8_POSITION_SIZE) * XREF8_USE_SIZE;
+    if((get_u16(_use) != _file_id) || (get_u32(_use + 4) != _line)) return -1;
+    return get_u32(_use + 8);
+}
+
+string xref8::get_name(uint32_t _symbol){
+    return get_cstring(table(4) + get_u32(table(1) + (size_t)_symbol * XREF8_SYMBOL_SIZE));
+}
+
+uint8_t xref8::get_kind(uint32_t _symbol){
+    size_t _pos = table(1) + (size_t)_symbol * XREF8_SYMBOL_SIZE + 4;
+    return (_pos < data_size) ? data[_pos] : 0;
+}
+
+void xref8::get_definition(uint32_t _symbol, string &_file, uint32_t &_line){
+    size_t _pos = table(1) + (size_t)_symbol * XREF8_SYMBOL_SIZE;
+    _file = get_file(get_u16(_pos + 6));
+    _line = get_u32(_pos + 8);
+}
+
+uint32_t xref8::get_use_count(uint32_t _symbol){
+    return get_u32(table(1) + (size_t)_symbol * XREF8_SYMBOL_SIZE + 16);
+}
+
+void xref8::get_use(uint32_t _symbol, uint32_t _index, string &_file, uint32_t &_line){
+    size_t _use = table(2) + (size_t)(get_u32(table(1) + (size_t)_symbol * XREF8_SYMBOL_SIZE + 12) + _index) * XREF8_USE_SIZE;
+    _file = get_file(get_u16(_use));
+    _line = get_u32(_use + 4);
+}
+
+string xref8::get_file(uint16_t _file_id){
+    if(_file_id >= get_u32(8)) return "";
+    return get_cstring(table(4) + get_u32(table(0) + (size_t)_file_id * XREF8_FILE_SIZE));
+}
+
+//Byte offset of a table: 0 files, 1 symbols, 2 uses, 3 positions, 4 strings:
+size_t xref8::table(uint32_t _table){
+    size_t _pos = XREF8_HEADER_SIZE;
+    if(_table > 0) _pos += (size_t)get_u32(8) * XREF8_FILE_SIZE;
+    if(_table > 1) _pos += (size_t)get_u32(12) * XREF8_SYMBOL_SIZE;
+    if(_table > 2) _pos += (size_t)get_u32(16) * XREF8_USE_SIZE;
+    if(_table > 3) _pos += (size_t)get_u32(16) * XREF8_POSITION_SIZE;
+    return _pos;
+}
@@ -0,0 +1,76 @@
+/* ASM8, Intel 8008 Assembler
+ * By Yasin Morsli
+ * Cross-Reference Index
+ * Definition and use sites of labels, defines and macros, written as a sorted
+ * binary index that tools map and search in place
+*/
+
+#ifndef XREF8_H_
+#define XREF8_H_
+
+using namespace std;
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "map8.h"
+
+//Binary layout, all values little endian: a 32 byte header, the file names,
+//the symbols sorted by name, their uses grouped per symbol and sorted by
+//position, a table of use indices sorted by file and line, and finally the
+//NUL terminated strings:
+#define XREF8_MAGIC         "A8XR"
+#define XREF8_VERSION       1
+#define XREF8_HEADER_SIZE   32
+#define XREF8_FILE_SIZE     4
+#define XREF8_SYMBOL_SIZE   20
+#define XREF8_USE_SIZE      12
+#define XREF8_POSITION_SIZE 4
+
+class xref_symbol_t{
+    public:
+        enum symbol_kind {symbol_label = 0, symbol_define = 1, symbol_macro = 2};
+
+        string      name;
+        uint8_t     kind;
+        uint16_t    file_id;
+        uint32_t    line;
+
+        xref_symbol_t(string _name = "", uint8_t _kind = symbol_label, uint16_t _file_id = 0, uint32_t _line = 0);
+};
+
+class xref_use_t{
+    public:
+        uint32_t    symbol;
+        uint16_t    file_id;
+        uint32_t    line;
+
+        xref_use_t(uint32_t _symbol = 0, uint16_t _file_id = 0, uint32_t _line = 0);
+        bool operator<(const xref_use_t &_other) const;
+        bool operator==(const xref_use_t &_other) const;
+};
+
+class xref8 : public mapped_file_t{
+    public:
+        vector<string>          files;
+        vector<xref_symbol_t>   symbols;
+        vector<xref_use_t>      uses;
+
+        int write(string _filename);
+
+        bool open(string _filename);
+        void close();
+        int32_t find(const string &_name);
+        int32_t find_at(const string &_file, uint32_t _line);
+        string get_name(uint32_t _symbol);
+        uint8_t get_kind(uint32_t _symbol);
+        void get_definition(uint32_t _symbol, string &_file, uint32_t &_line);
+        uint32_t get_use_count(uint32_t _symbol);
+        void get_use(uint32_t _symbol, uint32_t _index, string &_file, uint32_t &_line);
+
+        string get_file(uint16_t _file_id);
+        size_t table(uint32_t _table);
+};
+
+#endif /* XREF8_H_ */